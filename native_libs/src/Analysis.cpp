@@ -1,7 +1,20 @@
 #include "Analysis.h"
 
 #include "Processing.h"
-
+#include "Sort.h"
+#include "Statistics.h"
+#include "Core/FourierTransform.h"
+#include "Core/Grouping.h"
+#include "Core/Parallel.h"
+#include "Core/QuantileSketch.h"
+#include "Core/Reduction.h"
+
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <set>
 #include <unordered_map>
 
 #include <boost/accumulators/accumulators.hpp>
@@ -16,64 +29,197 @@ std::common_type_t<T, double> vectorNthElement(std::vector<T> &data, int32_t n)
     return data[n];
 }
 
-template<typename T>
-std::common_type_t<T, double> vectorQuantile(std::vector<T> &data, double q = 0.5)
+// Quantile q of N values lies between values of ranks n1 and n2 (when sorted), at t between them.
+struct QuantilePosition
 {
-    assert(!data.empty());
+    int64_t n1;
+    int64_t n2;
+    double t;
+
+    QuantilePosition(int64_t N, double q)
+    {
+        q = std::clamp(q, 0.0, 1.0);
+        const double n = std::clamp(N * q - 0.5, 0.0, N - 1.0);
+        n1 = static_cast<int64_t>(std::floor(n));
+        n2 = static_cast<int64_t>(std::ceil(n));
+        t = n - n1;
+    }
+};
+
+// Reorders the range.
+template<typename Iterator>
+double rangeQuantile(Iterator begin, Iterator end, double q = 0.5)
+{
+    assert(begin != end);
 
     if(q >= 1.0)
-        return *std::max_element(data.begin(), data.end());
+        return *std::max_element(begin, end);
     if(q <= 0)
-        return *std::min_element(data.begin(), data.end());
+        return *std::min_element(begin, end);
+
+    const QuantilePosition position(end - begin, q);
+    std::nth_element(begin, begin + position.n1, end);
+    std::nth_element(begin + position.n1, begin + position.n2, end);
+    return lerp<double>(begin[position.n1], begin[position.n2], position.t);
+}
+
+// Places values of all given ranks (sorted, relative to begin) where they would be after sorting.
+// Selecting the middle rank splits both the range and the ranks, so K ranks cost about log(K) passes.
+template<typename Iterator>
+void multiSelect(Iterator begin, Iterator end, const int64_t *ranksBegin, const int64_t *ranksEnd)
+{
+    if(ranksBegin == ranksEnd)
+        return;
+
+    const auto middle = ranksBegin + (ranksEnd - ranksBegin) / 2;
+    std::nth_element(begin, begin + *middle, end);
+
+    multiSelect(begin, begin + *middle, ranksBegin, middle);
 
-    q = std::clamp(q, 0.0, 1.0);
-    const double n = data.size() * q - 0.5;
-    const int n1 = static_cast<int>(std::floor(n));
-    const int n2 = static_cast<int>(std::ceil(n));
-    const auto t = n - n1;
-    std::nth_element(data.begin(), data.begin() + n1, data.end());
-    std::nth_element(data.begin() + n1, data.begin() + n2, data.end());
-    return lerp<double>(data[n1], data[n2], t);
+    // ranks on the right are relative to the element after the selected one
+    std::vector<int64_t> rightRanks;
+    for(auto rank = middle + 1; rank != ranksEnd; ++rank)
+        rightRanks.push_back(*rank - *middle - 1);
+    multiSelect(begin + *middle + 1, end, rightRanks.data(), rightRanks.data() + rightRanks.size());
+}
+
+// Reorders the vector.
+template<typename T>
+std::vector<double> vectorQuantiles(std::vector<T> &data, const std::vector<double> &qs)
+{
+    assert(!data.empty());
+
+    const auto positions = transformToVector(qs, [&] (double q) { return QuantilePosition(data.size(), q); });
+    std::vector<int64_t> ranks;
+    for(auto &position : positions)
+    {
+        ranks.push_back(position.n1);
+        ranks.push_back(position.n2);
+    }
+    std::sort(ranks.begin(), ranks.end());
+    ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+    multiSelect(data.begin(), data.end(), ranks.data(), ranks.data() + ranks.size());
+
+    return transformToVector(positions, [&] (const QuantilePosition &position)
+    {
+        return lerp<double>(data[position.n1], data[position.n2], position.t);
+    });
+}
+
+template<typename T>
+std::common_type_t<T, double> vectorQuantile(std::vector<T> &data, double q = 0.5)
+{
+    return rangeQuantile(data.begin(), data.end(), q);
 }
 
+// Integers spanning at most this many values (or the row count, if greater) are counted in an
+// array indexed by value rather than in a hash table.
+constexpr int64_t MaxDirectCountSpan = 1 << 16;
 
 template<arrow::Type::type id>
-std::shared_ptr<arrow::Table> countValueTyped(const arrow::Column &column)
+std::shared_ptr<arrow::Table> countValueTyped(const arrow::Column &column, std::optional<int64_t> topN)
 {
-    using T = typename TypeDescription<id>::ObservedType;
     using ArrowType = typename TypeDescription<id>::ArrowType;
-    using Builder = typename TypeDescription<id>::BuilderType;
-    std::unordered_map<T, int64_t> valueCounts;
 
-    iterateOver<id>(column,
-        [&] (auto &&elem) { valueCounts[elem]++; },
-        [] () {});
+    if(topN && *topN < 0)
+        THROW("number of top values must not be negative, got {}", *topN);
 
-    auto valueBuilder = makeBuilder(std::static_pointer_cast<ArrowType>(column.field()->type()));
-    arrow::Int64Builder countBuilder;
+    // values are read as group keys: strings are views into the column, doubles their normalized bits
+    const auto keysAndValid = readGroupKeys<id>(column);
+    const auto &keys = keysAndValid.first;
+    const auto &valid = keysAndValid.second;
+    using Key = typename std::decay_t<decltype(keys)>::value_type;
+    const int64_t N = keys.size();
+
+    std::vector<Key> values;
+    std::vector<int64_t> counts;
+    bool countedDirectly = false;
+    if constexpr(id == arrow::Type::INT64 || id == arrow::Type::TIMESTAMP)
+    {
+        auto min = std::numeric_limits<int64_t>::max();
+        auto max = std::numeric_limits<int64_t>::lowest();
+        for(int64_t row = 0; row < N; row++)
+        {
+            if(valid[row])
+            {
+                min = std::min(min, (int64_t)keys[row]);
+                max = std::max(max, (int64_t)keys[row]);
+            }
+        }
+
+        if(min <= max && (uint64_t)max - (uint64_t)min < (uint64_t)std::max(N, MaxDirectCountSpan))
+        {
+            std::vector<int64_t> slots((uint64_t)max - (uint64_t)min + 1);
+            for(int64_t row = 0; row < N; row++)
+                if(valid[row])
+                    ++slots[keys[row] - (uint64_t)min];
 
-    valueBuilder->Reserve(valueCounts.size());
-    countBuilder.Reserve(valueCounts.size());
+            for(size_t i = 0; i < slots.size(); i++)
+            {
+                if(slots[i])
+                {
+                    values.push_back((uint64_t)min + i);
+                    counts.push_back(slots[i]);
+                }
+            }
+            countedDirectly = true;
+        }
+    }
 
-    for(auto && [value, count] : valueCounts)
+    if(!countedDirectly)
     {
-        append(*valueBuilder, value);
-        append(countBuilder, count);
+        const auto groups = groupRows(keys, valid);
+        const auto sizes = groups.groupSizes();
+        for(int64_t group = groups.hasNulls; group < groups.groupCount; group++)
+        {
+            values.push_back(keys[groups.firstRows[group]]);
+            counts.push_back(sizes[group]);
+        }
     }
 
-    if(column.null_count())
+    // index one past the values stands for nulls
+    const int64_t nullIndex = values.size();
+    std::vector<int64_t> order(values.size() + (column.null_count() != 0));
+    std::iota(order.begin(), order.end(), 0);
+    if(topN && *topN < (int64_t)order.size())
     {
-        valueBuilder->AppendNull();
-        countBuilder.Append(column.null_count());
+        const auto countOf = [&] (int64_t index) { return index == nullIndex ? column.null_count() : counts[index]; };
+        const auto moreFrequent = [&] (int64_t lhs, int64_t rhs)
+        {
+            return countOf(lhs) != countOf(rhs) ? countOf(lhs) > countOf(rhs) : lhs < rhs;
+        };
+        std::partial_sort(order.begin(), order.begin() + *topN, order.end(), moreFrequent);
+        order.resize(*topN);
     }
 
-    auto valueArray = finish(*valueBuilder);
-    auto countArray = finish(countBuilder);
+    auto valueBuilder = makeBuilder(std::static_pointer_cast<ArrowType>(column.field()->type()));
+    arrow::Int64Builder countBuilder;
+    valueBuilder->Reserve(order.size());
+    countBuilder.Reserve(order.size());
+    for(auto index : order)
+    {
+        if(index == nullIndex)
+        {
+            valueBuilder->AppendNull();
+            countBuilder.Append(column.null_count());
+            continue;
+        }
 
-    auto valueColumn = std::make_shared<arrow::Column>(arrow::field("value", column.type(), column.null_count()), valueArray);
-    auto countColumn = std::make_shared<arrow::Column>(arrow::field("count", countArray->type(), false), countArray);
+        const auto &key = values[index];
+        if constexpr(id == arrow::Type::DOUBLE)
+        {
+            double value;
+            std::memcpy(&value, &key, sizeof(value));
+            append(*valueBuilder, value);
+        }
+        else if constexpr(id == arrow::Type::STRING)
+            append(*valueBuilder, key);
+        else
+            valueBuilder->Append((int64_t)key);
+        countBuilder.Append(counts[index]);
+    }
 
-    return tableFromArrays({valueArray, countArray}, {"value", "count"});
+    return tableFromArrays({finish(*valueBuilder), finish(countBuilder)}, {"value", "count"});
 }
 
 template<typename T>
@@ -95,6 +241,7 @@ struct Minimum
     void operator() (T elem) { accumulator = std::min<T>(accumulator, elem); }
     void operator() () {}
     auto get() { return accumulator; }
+    static T reduce(const arrow::ChunkedArray &array) { return reduceMin<T>(array); }
 };
 
 template<typename T>
@@ -106,6 +253,7 @@ struct Maximum
     void operator() (T elem) { accumulator = std::max<T>(accumulator, elem); }
     void operator() () {}
     auto get() { return accumulator; }
+    static T reduce(const arrow::ChunkedArray &array) { return reduceMax<T>(array); }
 };
 
 // TODO naive implementation, look for something numerically better
@@ -119,6 +267,11 @@ struct Mean
     void operator() (T elem) { accumulator += elem; count++; }
     void operator() () {}
     auto get() { return accumulator / (double)count; }
+    static double reduce(const arrow::ChunkedArray &array)
+    {
+        const auto sumAndCount = reduceSum<T>(array);
+        return sumAndCount.sum / (double)sumAndCount.count;
+    }
 };
 
 template<typename T>
@@ -133,6 +286,24 @@ struct Median
     auto get() { return vectorQuantile(values, 0.5); }
 };
 
+template<typename T>
+struct ApproximateMedian
+{
+    QuantileSketch sketch;
+
+    static constexpr const char *name = "approximate median";
+    static constexpr int32_t RequiredSampleCount = 1;
+    void operator() (T elem)
+    {
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(elem))
+                return;
+        sketch.add(elem);
+    }
+    void operator() () {}
+    auto get() { return sketch.quantile(0.5); }
+};
+
 template<typename T>
 struct Variance
 {
@@ -143,6 +314,7 @@ struct Variance
     void operator() (T elem) { accumulator(elem); }
     void operator() () {}
     auto get() { return boost::accumulators::variance(accumulator); }
+    static double reduce(const arrow::ChunkedArray &array) { return reduceVariance<T>(array); }
 };
 
 template<typename T>
@@ -150,6 +322,7 @@ struct StdDev : Variance<T>
 {
     static constexpr const char *name = "std dev";
     auto get() { return std::sqrt(Variance<T>::get()); }
+    static double reduce(const arrow::ChunkedArray &array) { return std::sqrt(reduceVariance<T>(array)); }
 };
 
 template<typename T>
@@ -161,6 +334,7 @@ struct Sum : Variance<T>
     void operator() (T elem) { accumulator += elem; }
     void operator() () {}
     T get() { return accumulator; }
+    static T reduce(const arrow::ChunkedArray &array) { return reduceSum<T>(array).sum; }
 };
 
 struct Length
@@ -251,6 +425,7 @@ template<typename T> struct AggregatorFor<AggregateFunction::Last   , T> { using
 template<typename T> struct AggregatorFor<AggregateFunction::Sum    , T> { using type = Sum<T>    ; };
 template<typename T> struct AggregatorFor<AggregateFunction::RSI    , T> { using type = RSI<T>    ; };
 template<typename T> struct AggregatorFor<AggregateFunction::StdDev , T> { using type = StdDev<T> ; };
+template<typename T> struct AggregatorFor<AggregateFunction::ApproximateMedian, T> { using type = ApproximateMedian<T>; };
 
 template<arrow::Type::type id, typename Processor>
 auto calculateStatScalar(const arrow::Column &column, Processor &p)
@@ -272,6 +447,13 @@ auto dispatchIndexable(const std::shared_ptr<arrow::Column> &column, F &&f)
         return f(column);
 }
 
+// Processors providing static reduce(chunkedArray) are computed with kernels from Core/Reduction.h
+// instead of being fed values one by one.
+template<typename Processor, typename = void>
+struct HasReductionKernel : std::false_type {};
+template<typename Processor>
+struct HasReductionKernel<Processor, std::void_t<decltype(Processor::reduce(std::declval<const arrow::ChunkedArray &>()))>> : std::true_type {};
+
 /// workaround for VS 15.9 regression, see function below
 template<template <typename> typename Processor>
 struct CalculateStatVisitor
@@ -298,8 +480,16 @@ struct CalculateStatVisitor
         if (column.length() - column.null_count() <= 0)
             return toColumn(std::vector<std::optional<ResultT>>{std::nullopt}, p.name);
 
-        const auto result = calculateStatScalar<id.value>(column, p);
-        return toColumn(std::vector<ResultT>{result}, { p.name });
+        if constexpr(HasReductionKernel<Processor<T>>::value)
+        {
+            const ResultT result = Processor<T>::reduce(*column.data());
+            return toColumn(std::vector<ResultT>{result}, { p.name });
+        }
+        else
+        {
+            const auto result = calculateStatScalar<id.value>(column, p);
+            return toColumn(std::vector<ResultT>{result}, { p.name });
+        }
     }
 };
 
@@ -346,11 +536,11 @@ std::shared_ptr<arrow::Column> calculateQuantile(const arrow::Column &column, do
     }, v);
 }
 
-std::shared_ptr<arrow::Table> countValues(const arrow::Column &column)
+std::shared_ptr<arrow::Table> countValues(const arrow::Column &column, std::optional<int64_t> topN)
 {
     return visitType(*column.type(), [&] (auto id)
     {
-        return countValueTyped<id.value>(column);
+        return countValueTyped<id.value>(column, topN);
     });
 }
 
@@ -379,6 +569,44 @@ std::shared_ptr<arrow::Column> calculateQuantile(const arrow::Column &column, do
     return calculateQuantile(column, q, "quantile " + std::to_string(q));
 }
 
+std::shared_ptr<arrow::Column> calculateQuantiles(const arrow::Column &column, const std::vector<double> &qs)
+{
+    auto v = toJustVector(column);
+    return visit([&] (auto &vector) -> std::shared_ptr<arrow::Column>
+    {
+        using VectorType = std::decay_t<decltype(vector)>;
+        using T = typename VectorType::value_type;
+        if constexpr(std::is_arithmetic_v<T>)
+        {
+            if(vector.empty())
+                THROW("cannot calculate quantiles of column without values");
+            return toColumn(vectorQuantiles(vector, qs), "quantiles");
+        }
+        else
+            throw std::runtime_error("quantiles are allowed only for arithmetics type");
+    }, v);
+}
+
+std::shared_ptr<arrow::Column> calculateQuantile(const arrow::Column &column, double q, std::optional<double> sketchCompression)
+{
+    if(!sketchCompression)
+        return calculateQuantile(column, q);
+
+    const auto name = "quantile " + std::to_string(q);
+    return visitType(*column.type(), [&] (auto id) -> std::shared_ptr<arrow::Column>
+    {
+        using T = typename TypeDescription<id.value>::ObservedType;
+        if constexpr(std::is_arithmetic_v<T>)
+        {
+            ApproximateMedian<T> aggregator{QuantileSketch{*sketchCompression}};
+            iterateOver<id.value>(column, aggregator, aggregator);
+            return scalarToColumn(aggregator.sketch.quantile(q), name);
+        }
+        else
+            throw std::runtime_error(name + " is allowed only for arithmetics type");
+    });
+}
+
 std::shared_ptr<arrow::Array> fromMemory(double *data, int32_t dataCount)
 {
     arrow::DoubleBuilder builder;
@@ -412,58 +640,317 @@ std::shared_ptr<arrow::Column> calculateSum(const arrow::Column &column)
     return calculateStat<Sum>(column);
 }
 
-double calculateCorrelation(const arrow::Column &xCol, const arrow::Column &yCol)
+struct ColumnDescription
 {
-    if(xCol.null_count() >= xCol.length() || yCol.null_count() >= yCol.length())
-        return std::numeric_limits<double>::quiet_NaN();
+    int64_t count = 0;
+    int64_t nullCount = 0;
+    int64_t distinct = 0;
+    std::optional<double> min, max, mean, stdDev;
+    std::vector<std::optional<double>> quantiles;
+};
 
-    struct CorrelationStats
-    {
-        double sumX = 0;
-        double sumY = 0;
-        double sumXX = 0;
-        double sumYY = 0;
-        double sumXY = 0;
-        int64_t n = 0;
+template<arrow::Type::type id>
+ColumnDescription describeColumn(const arrow::Column &column, const std::vector<double> &qs)
+{
+    using T = typename TypeDescription<id>::ObservedType;
+
+    ColumnDescription ret;
+    ret.quantiles.resize(qs.size());
+    ret.nullCount = column.null_count();
+    ret.count = column.length() - ret.nullCount;
+
+    DistinctCounter distinct;
+    std::vector<double> values;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0;
+    if constexpr(std::is_arithmetic_v<T>)
+        values.reserve(ret.count);
 
-        void addPair(double xVal, double yVal)
+    iterateOver<id>(column,
+        [&] (auto &&observed)
         {
-            sumX += xVal;
-            sumY += yVal;
-            sumXX += xVal * xVal;
-            sumYY += yVal * yVal;
-            sumXY += xVal * yVal;
-            n++;
-        }
+            const auto value = toStorage(observed);
+            if constexpr(id == arrow::Type::STRING)
+                distinct.add(hashKey(value));
+            else if constexpr(id == arrow::Type::DOUBLE)
+                distinct.add(hashKey(normalizedKeyBits(value)));
+            else
+                distinct.add(hashKey(static_cast<uint64_t>(value)));
+
+            if constexpr(std::is_arithmetic_v<T>)
+            {
+                if constexpr(std::is_floating_point_v<T>)
+                    if(std::isnan(value))
+                        return;
+                values.push_back(value);
+                min = std::min<double>(min, value);
+                max = std::max<double>(max, value);
+                sum += value;
+            }
+        },
+        [] {});
+    ret.distinct = std::clamp<int64_t>(distinct.estimate(), ret.count > 0, ret.count);
+
+    if(values.empty())
+        return ret;
 
-        double correlation() const
+    ret.min = min;
+    ret.max = max;
+
+    // the variance's second pass and the quantile selection run over the contiguous copy
+    const auto moments = meanAndVarianceAround(values.data(), values.size(), sum / values.size());
+    ret.mean = moments.mean;
+    ret.stdDev = std::sqrt(moments.variance);
+
+    const auto quantiles = vectorQuantiles(values, qs);
+    std::copy(quantiles.begin(), quantiles.end(), ret.quantiles.begin());
+    return ret;
+}
+
+std::shared_ptr<arrow::Table> describeTable(const arrow::Table &table, const std::vector<double> &qs)
+{
+    const auto columns = getColumns(table);
+    std::vector<ColumnDescription> descriptions(columns.size());
+    parallelFor(columns.size(), [&] (int64_t index)
+    {
+        descriptions[index] = visitType(*columns[index]->type(), [&] (auto id)
         {
-            const auto num = n * sumXY - sumX * sumY;
-            const auto den = std::sqrt(n * sumXX - (sumX*sumX)) * std::sqrt(n * sumYY - (sumY*sumY));
-            return num / den;
-        }
-    };
+            return describeColumn<id.value>(*columns[index], qs);
+        });
+    });
+
+    std::vector<std::string> statistics{"count", "null count", "distinct", "min", "max", "mean", "std dev"};
+    for(auto q : qs)
+        statistics.push_back("quantile " + std::to_string(q));
+
+    std::vector<std::shared_ptr<arrow::Column>> resultColumns{toColumn(statistics, "statistic")};
+    for(size_t i = 0; i < columns.size(); i++)
+    {
+        const auto &description = descriptions[i];
+        std::vector<std::optional<double>> values{(double)description.count, (double)description.nullCount, (double)description.distinct,
+            description.min, description.max, description.mean, description.stdDev};
+        values.insert(values.end(), description.quantiles.begin(), description.quantiles.end());
+        resultColumns.push_back(toColumn(values, columns[i]->name()));
+    }
+    return tableFromColumns(resultColumns);
+}
+
+// Correlations are computed from sums over rows where both columns are valid (pairwise-complete).
+// Values are first centered by their column's mean, so the sums don't cancel catastrophically,
+// and nulls become zeroes with zero in a mask column. Then all sums are dot products of these
+// columns, a blocked Gram matrix: rows are processed in tiles sized so that all columns' tile
+// data fits in cache, and within each, pairs of blocks of columns are distributed among threads.
+
+// bytes of all columns' tile data (values and masks)
+constexpr int64_t CorrelationTileBytes = 4 << 20;
+// bounds on rows in a tile: enough for long dot products, few enough not to need more cache
+constexpr int64_t CorrelationMinTileRows = 256;
+constexpr int64_t CorrelationMaxTileRows = 1 << 14;
+// columns in a block
+constexpr int64_t CorrelationBlockColumns = 8;
+
+// Independent accumulators, so the additions don't wait for each other (compilers vectorize
+// the lane loops).
+constexpr int DotProductLanes = 8;
+
+double dotProduct(const double *a, const double *b, int64_t count)
+{
+    int64_t i = 0;
+    double acc[DotProductLanes] = {};
+    for( ; i + DotProductLanes <= count; i += DotProductLanes)
+        for(int lane = 0; lane < DotProductLanes; lane++)
+            acc[lane] += a[i + lane] * b[i + lane];
+
+    double sum = 0;
+    for(auto laneSum : acc)
+        sum += laneSum;
+    for( ; i < count; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// Sum of a[i]^2 * mask[i], squares are computed on the fly instead of being stored.
+double maskedSumOfSquares(const double *a, const double *mask, int64_t count)
+{
+    int64_t i = 0;
+    double acc[DotProductLanes] = {};
+    for( ; i + DotProductLanes <= count; i += DotProductLanes)
+        for(int lane = 0; lane < DotProductLanes; lane++)
+            acc[lane] += a[i + lane] * a[i + lane] * mask[i + lane];
+
+    double sum = 0;
+    for(auto laneSum : acc)
+        sum += laneSum;
+    for( ; i < count; i++)
+        sum += a[i] * a[i] * mask[i];
+    return sum;
+}
+
+// Sums over rows where both x and y are valid, of centered values.
+struct CorrelationSums
+{
+    double n = 0;
+    double sumX = 0;
+    double sumY = 0;
+    double sumXX = 0;
+    double sumYY = 0;
+    double sumXY = 0;
+
+    double correlation() const
+    {
+        const auto covariance = sumXY - sumX * sumY / n;
+        const auto varianceX = sumXX - sumX * sumX / n;
+        const auto varianceY = sumYY - sumY * sumY / n;
+        return covariance / std::sqrt(varianceX * varianceY);
+    }
+};
+
+// Centered values of a column's rows in the current tile. Columns with nulls also have the mask,
+// to restrict sums to rows valid in the other column.
+struct CorrelationTile
+{
+    double mean = 0;
+    bool hasNulls = false;
+    std::vector<double> values;
+    std::vector<double> mask;
+
+    // over the tile's valid rows
+    double count = 0;
+    double sum = 0;
+    double sumOfSquares = 0;
+};
 
-    auto stats = visitType(*xCol.type(), [&] (auto id1)
+void loadCorrelationTile(const arrow::Column &column, int64_t begin, int64_t end, CorrelationTile &tile)
+{
+    tile.values.clear();
+    tile.mask.clear();
+    visitType(*column.type(), [&] (auto id)
     {
-        return visitType(*yCol.type(), [&] (auto id2) -> CorrelationStats
+        if constexpr(id.value != arrow::Type::STRING)
         {
-            if constexpr(id1.value != arrow::Type::STRING  &&  id2.value != arrow::Type::STRING)
-            {
-                CorrelationStats stats;
-                iterateOverJustPairs<id1.value, id2.value>(xCol, yCol,
-                    [&] (auto xVal, auto yVal)
+            iterateOver<id.value>(*column.Slice(begin, end - begin),
+                [&] (auto value)
+                {
+                    tile.values.push_back(toStorage(value) - tile.mean);
+                    if(tile.hasNulls)
+                        tile.mask.push_back(1);
+                },
+                [&] ()
                 {
-                    stats.addPair(toStorage(xVal), toStorage(yVal));
+                    tile.values.push_back(0);
+                    tile.mask.push_back(0);
                 });
-                return stats;
-            }
+        }
+        else
+            throw std::runtime_error("Correlation not supported on string types");
+    });
+
+    tile.count = tile.hasNulls ? std::accumulate(tile.mask.begin(), tile.mask.end(), 0.0) : tile.values.size();
+    tile.sum = std::accumulate(tile.values.begin(), tile.values.end(), 0.0);
+    tile.sumOfSquares = dotProduct(tile.values.data(), tile.values.data(), tile.values.size());
+}
+
+void accumulateCorrelationSums(const CorrelationTile &x, const CorrelationTile &y, CorrelationSums &sums)
+{
+    const int64_t count = x.values.size();
+    sums.sumXY += dotProduct(x.values.data(), y.values.data(), count);
+
+    // nulls are zeroes, so sums of a column need masking only by the other column's nulls
+    if(x.hasNulls && y.hasNulls)
+        sums.n += dotProduct(x.mask.data(), y.mask.data(), count);
+    else
+        sums.n += x.hasNulls ? x.count : y.count;
+
+    if(y.hasNulls)
+    {
+        sums.sumX += dotProduct(x.values.data(), y.mask.data(), count);
+        sums.sumXX += maskedSumOfSquares(x.values.data(), y.mask.data(), count);
+    }
+    else
+    {
+        sums.sumX += x.sum;
+        sums.sumXX += x.sumOfSquares;
+    }
+
+    if(x.hasNulls)
+    {
+        sums.sumY += dotProduct(y.values.data(), x.mask.data(), count);
+        sums.sumYY += maskedSumOfSquares(y.values.data(), x.mask.data(), count);
+    }
+    else
+    {
+        sums.sumY += y.sum;
+        sums.sumYY += y.sumOfSquares;
+    }
+}
+
+// Correlations between all pairs of columns, [i * N + j] for i < j.
+std::vector<double> correlationMatrix(const std::vector<const arrow::Column *> &columns)
+{
+    const int64_t N = columns.size();
+    const int64_t rowCount = N ? columns.front()->length() : 0;
+    for(auto column : columns)
+        if(column->length() != rowCount)
+            THROW("cannot calculate correlation: column `{}` has {} rows, expected {}", column->name(), column->length(), rowCount);
+
+    std::vector<CorrelationTile> tiles(N);
+    parallelFor(N, [&] (int64_t i)
+    {
+        const auto &column = *columns[i];
+        auto &tile = tiles[i];
+        tile.hasNulls = column.null_count() > 0;
+
+        double sum = 0;
+        int64_t count = 0;
+        visitType(*column.type(), [&] (auto id)
+        {
+            if constexpr(id.value != arrow::Type::STRING)
+                iterateOver<id.value>(column, [&] (auto value) { sum += toStorage(value); ++count; }, [] {});
             else
                 throw std::runtime_error("Correlation not supported on string types");
         });
+        tile.mean = count ? sum / count : 0;
     });
 
-    return stats.correlation();
+    // pairs of column blocks (including a block with itself), each task owns the sums of its pairs
+    const auto blockCount = (N + CorrelationBlockColumns - 1) / CorrelationBlockColumns;
+    std::vector<std::pair<int64_t, int64_t>> blockPairs;
+    for(int64_t i = 0; i < blockCount; ++i)
+        for(int64_t j = i; j < blockCount; ++j)
+            blockPairs.emplace_back(i, j);
+
+    // values take 8 bytes per row, masks another 8
+    int64_t bytesPerRow = 0;
+    for(auto &tile : tiles)
+        bytesPerRow += tile.hasNulls ? 16 : 8;
+    const auto tileRows = std::clamp(CorrelationTileBytes / std::max<int64_t>(bytesPerRow, 1), CorrelationMinTileRows, CorrelationMaxTileRows);
+
+    std::vector<CorrelationSums> sums(N * N);
+    for(int64_t tileBegin = 0; tileBegin < rowCount; tileBegin += tileRows)
+    {
+        const auto tileEnd = std::min(rowCount, tileBegin + tileRows);
+        parallelFor(N, [&] (int64_t i)
+        {
+            loadCorrelationTile(*columns[i], tileBegin, tileEnd, tiles[i]);
+        });
+        parallelFor(blockPairs.size(), [&] (int64_t pairIndex)
+        {
+            const auto [blockI, blockJ] = blockPairs[pairIndex];
+            const auto iEnd = std::min(N, (blockI + 1) * CorrelationBlockColumns);
+            const auto jEnd = std::min(N, (blockJ + 1) * CorrelationBlockColumns);
+            for(auto i = blockI * CorrelationBlockColumns; i < iEnd; ++i)
+                for(auto j = std::max(i + 1, blockJ * CorrelationBlockColumns); j < jEnd; ++j)
+                    accumulateCorrelationSums(tiles[i], tiles[j], sums[i * N + j]);
+        });
+    }
+
+    return transformToVector(sums, [] (const CorrelationSums &pairSums) { return pairSums.correlation(); });
+}
+
+double calculateCorrelation(const arrow::Column &xCol, const arrow::Column &yCol)
+{
+    return correlationMatrix({ &xCol, &yCol })[1];
 }
 
 std::shared_ptr<arrow::Column> calculateCorrelation(const arrow::Table &table, const arrow::Column &column)
@@ -490,29 +977,16 @@ std::shared_ptr<arrow::Column> calculateCorrelation(const arrow::Table &table, c
 std::shared_ptr<arrow::Table> calculateCorrelationMatrix(const arrow::Table &table)
 {
     const auto N = table.num_columns();
-    std::vector<std::vector<double>> correlationMatrix;
-    correlationMatrix.resize(N);
-    for(auto &correlationColumn : correlationMatrix)
-        correlationColumn.resize(N);
-
-    for(int i = 0; i < N; i++)
-    {
-        const auto ci = table.column(i);
-        correlationMatrix[i][i] = 1.0;
-        for(int j = i + 1; j < N; j++)
-        {
-            const auto cj = table.column(j);
-            const auto correlation = calculateCorrelation(*ci, *cj);
-            correlationMatrix[i][j] = correlation;
-            correlationMatrix[j][i] = correlation;
-        }
-    }
+    const auto columns = getColumns(table);
+    const auto correlations = correlationMatrix(transformToVector(columns, [] (auto &&column) -> const arrow::Column * { return column.get(); }));
 
     std::vector<std::shared_ptr<arrow::Column>> ret;
     for(int i = 0; i < N; i++)
     {
-        auto c = toColumn(correlationMatrix.at(i), table.column(i)->name());
-        ret.push_back(c);
+        std::vector<double> correlationColumn(N);
+        for(int j = 0; j < N; j++)
+            correlationColumn[j] = i == j ? 1.0 : correlations[std::min(i, j) * N + std::max(i, j)];
+        ret.push_back(toColumn(correlationColumn, columns[i]->name()));
     }
 
     return tableFromColumns(ret);
@@ -521,240 +995,566 @@ std::shared_ptr<arrow::Table> calculateCorrelationMatrix(const arrow::Table &tab
 double autoCorrelation(const std::shared_ptr<arrow::Column> &column, int64_t lag /*= 1*/)
 {
     auto shiftedColumn = shift(column, lag);
-    auto debug = toVector<std::optional<int64_t>>(*shiftedColumn);
     return calculateCorrelation(*column, *shiftedColumn);
 }
 
-template<typename T>
-struct AggregateBase
+// lags up to this are computed directly as dot products, FFT pays off for more
+constexpr int64_t MaxDirectAutoCorrelationLag = 128;
+// minimal number of rows in a block correlated with a single FFT
+constexpr int64_t MinAutoCorrelationBlockRows = 1 << 10;
+
+// Sums of x[t] * x[t + lag] for lags 0..maxLag.
+//
+// For larger lags the series is split into blocks of rows, each correlated with itself extended by
+// the next maxLag rows. Both sequences are transformed at once, as real and imaginary part of one
+// complex FFT, and the product of their spectra transformed back gives the block's contribution
+// to all lags. Transform size is twice the block, so the circular correlation doesn't wrap around.
+// Blocks are processed in parallel and the cost is O(N log(maxLag)).
+std::vector<double> laggedProductSums(const std::vector<double> &x, int64_t maxLag)
 {
-    virtual ~AggregateBase(){}
+    const int64_t N = x.size();
+    if(maxLag <= MaxDirectAutoCorrelationLag)
+    {
+        std::vector<double> ret(maxLag + 1);
+        parallelFor(maxLag + 1, [&] (int64_t lag)
+        {
+            ret[lag] = dotProduct(x.data(), x.data() + lag, N - lag);
+        });
+        return ret;
+    }
 
-    virtual void operator()(T t) = 0;
-    virtual void operator()() = 0;
-    virtual std::optional<double> get(bool hadValidValue) = 0;
-    virtual std::string name() = 0;
-};
+    int64_t blockRows = MinAutoCorrelationBlockRows;
+    while(blockRows <= maxLag)
+        blockRows *= 2;
+    const FourierTransform transform{2 * blockRows};
+    const auto M = transform.size();
+    const auto blockCount = (N + blockRows - 1) / blockRows;
+    const auto rangeCount = parallelRangeCount(blockCount, 1);
+
+    std::vector<std::vector<double>> partialSums(rangeCount, std::vector<double>(maxLag + 1));
+    parallelForRanges(blockCount, rangeCount, [&] (int64_t rangeIndex, int64_t firstBlock, int64_t endBlock)
+    {
+        auto &sums = partialSums[rangeIndex];
+        std::vector<std::complex<double>> spectrum(M), product(M);
+        for(auto block = firstBlock; block < endBlock; block++)
+        {
+            // real part: the block, imaginary part: the block followed by maxLag rows
+            const auto begin = block * blockRows;
+            for(int64_t t = 0; t < M; t++)
+            {
+                const auto value = begin + t < N ? x[begin + t] : 0.0;
+                spectrum[t] = { t < blockRows ? value : 0.0, t < blockRows + maxLag ? value : 0.0 };
+            }
+            transform.forward(spectrum);
 
-template<typename T, typename Aggregator>
-struct AggregateBy : AggregateBase<T>
+            // Spectra of real sequences are conjugate-symmetric, which separates them:
+            // A = (Z[k] + conj(Z[-k])) / 2, B = (Z[k] - conj(Z[-k])) / 2i. Cross-correlation's is conj(A) * B.
+            for(int64_t k = 0; k < M; k++)
+            {
+                const auto mirrored = std::conj(spectrum[(M - k) & (M - 1)]);
+                const auto sum = spectrum[k] + mirrored;
+                const auto difference = spectrum[k] - mirrored;
+                const auto ar = sum.real() / 2, ai = sum.imag() / 2;
+                const auto br = difference.imag() / 2, bi = -difference.real() / 2;
+                product[k] = { ar * br + ai * bi, ar * bi - ai * br };
+            }
+            transform.backward(product);
+
+            for(int64_t lag = 0; lag <= maxLag; lag++)
+                sums[lag] += product[lag].real() / M;
+        }
+    });
+
+    std::vector<double> ret(maxLag + 1);
+    for(auto &sums : partialSums)
+        for(int64_t lag = 0; lag <= maxLag; lag++)
+            ret[lag] += sums[lag];
+    return ret;
+}
+
+std::shared_ptr<arrow::Column> autoCorrelations(const arrow::Column &column, int64_t maxLag)
 {
-    Aggregator a;
+    if(maxLag < 0)
+        THROW("maximum lag must not be negative, got {}", maxLag);
 
-    virtual void operator()(T t) override
-    {
-        a(t);
-    }
-    virtual void operator()() override
-    {
-        a();
-    }
-    virtual std::optional<double> get(bool hadValidValue) override
+    std::vector<double> values;
+    values.reserve(column.length());
+    visitType(*column.type(), [&] (auto id)
     {
-        if(hadValidValue || !Aggregator::RequiredSampleCount)
-            return a.get();
-        return {};
-    }
-    virtual std::string name() override
+        if constexpr(id.value == arrow::Type::INT64 || id.value == arrow::Type::DOUBLE)
+        {
+            iterateOver<id.value>(column,
+                [&] (auto value) { values.push_back(value); },
+                [&] { values.push_back(std::numeric_limits<double>::quiet_NaN()); });
+        }
+        else
+            THROW("Autocorrelation not supported on type {}", column.type()->ToString());
+    });
+
+    // centered by the mean of values, nulls and NaNs become zeroes, so they add to no sum
+    double sum = 0;
+    int64_t count = 0;
+    for(auto value : values)
     {
-        return Aggregator::name;
+        if(!std::isnan(value))
+        {
+            sum += value;
+            ++count;
+        }
     }
-};
+    const auto mean = sum / count;
+    for(auto &value : values)
+        value = std::isnan(value) ? 0.0 : value - mean;
+
+    // lags from N on have no pairs
+    const auto lagsWithPairs = std::min<int64_t>(maxLag, std::max<int64_t>(values.size(), 1) - 1);
+    auto ret = laggedProductSums(values, lagsWithPairs);
+    ret.resize(maxLag + 1);
+
+    const auto variance = ret[0];
+    for(auto &product : ret)
+        product = variance > 0 ? product / variance : std::numeric_limits<double>::quiet_NaN();
+    return toColumn(ret, "autocorrelation");
+}
 
 template<AggregateFunction aggr, typename T>
 using AggregatorFor_t = typename AggregatorFor<aggr, T>::type;
 
+// Group aggregation keeps the state of each function as arrays indexed by group id, so a row
+// updates it with a single scatter into plain vectors. States are constructed knowing count of
+// valid values in each group and are given only the valid values. Partial states of consecutive
+// row ranges are merged group by group, in the order of ranges.
+
 template<typename T>
-std::unique_ptr<AggregateBase<T>> makeAggregator(AggregateFunction a)
+struct GroupedMinimum
 {
-    return dispatchAggregateByEnum(a, [] (auto aggrC) -> std::unique_ptr<AggregateBase<T>>
-    {
-        using Aggregator = AggregatorFor_t<aggrC.value, T>;
-        if constexpr(doesAggregatorAllowsType<T>(aggrC.value))
-            return std::make_unique<AggregateBy<T, Aggregator>>();
-        else
-            THROW("wrong type for function id={}", (int)aggrC.value);
-    });
-}
+    std::vector<T> accumulators;
+    GroupedMinimum(const std::vector<int64_t> &validCounts) : accumulators(validCounts.size(), std::numeric_limits<T>::max()) {}
+    void add(int64_t group, T value) { accumulators[group] = std::min<T>(accumulators[group], value); }
+    void merge(const GroupedMinimum &other, int64_t group) { add(group, other.accumulators[group]); }
+    double get(int64_t group) { return accumulators[group]; }
+};
+
+template<typename T>
+struct GroupedMaximum
+{
+    std::vector<T> accumulators;
+    GroupedMaximum(const std::vector<int64_t> &validCounts) : accumulators(validCounts.size(), std::numeric_limits<T>::lowest()) {}
+    void add(int64_t group, T value) { accumulators[group] = std::max<T>(accumulators[group], value); }
+    void merge(const GroupedMaximum &other, int64_t group) { add(group, other.accumulators[group]); }
+    double get(int64_t group) { return accumulators[group]; }
+};
 
-std::string aggregateName(AggregateFunction a)
+template<typename T>
+struct GroupedSum
 {
-    // inefficient, but should not be called that often
-    return makeAggregator<double>(a)->name();
-}
+    std::vector<T> sums;
+    GroupedSum(const std::vector<int64_t> &validCounts) : sums(validCounts.size()) {}
+    void add(int64_t group, T value) { sums[group] += value; }
+    void merge(const GroupedSum &other, int64_t group) { sums[group] += other.sums[group]; }
+    double get(int64_t group) { return sums[group]; }
+};
 
 template<typename T>
-struct Aggregators
+struct GroupedMean : GroupedSum<T>
 {
-    bool hadValidValue = false;
-    std::vector<std::unique_ptr<AggregateBase<T>>> aggregators;
-    Aggregators(const std::vector<AggregateFunction> &toAggregate)
-    {
-        aggregators = transformToVector(toAggregate, [](auto aggrEnum) { return makeAggregator<T>(aggrEnum); });
-    }
-    void operator()(T t)
+    const std::vector<int64_t> &validCounts;
+    GroupedMean(const std::vector<int64_t> &validCounts) : GroupedSum<T>(validCounts), validCounts(validCounts) {}
+    double get(int64_t group) { return this->sums[group] / (double)validCounts[group]; }
+};
+
+// Welford's algorithm, population variance
+template<typename T>
+struct GroupedVariance
+{
+    std::vector<int64_t> counts;
+    std::vector<double> means;
+    std::vector<double> m2s;
+    GroupedVariance(const std::vector<int64_t> &validCounts)
+        : counts(validCounts.size()), means(validCounts.size()), m2s(validCounts.size())
+    {}
+    void add(int64_t group, T value)
     {
-        hadValidValue = true;
-        for(auto &a : aggregators)
-            (*a)(t);
+        const auto delta = value - means[group];
+        means[group] += delta / ++counts[group];
+        m2s[group] += delta * (value - means[group]);
     }
-    void operator()()
+    // Chan et al. formula for combining variances of two sets
+    void merge(const GroupedVariance &other, int64_t group)
     {
-        for(auto &a : aggregators)
-            (*a)();
+        const auto otherCount = other.counts[group];
+        if(!otherCount)
+            return;
+
+        const auto count = counts[group] + otherCount;
+        const auto delta = other.means[group] - means[group];
+        means[group] += delta * otherCount / count;
+        m2s[group] += other.m2s[group] + delta * delta * counts[group] * otherCount / count;
+        counts[group] = count;
     }
+    double get(int64_t group) { return m2s[group] / counts[group]; }
 };
 
-// Cannot be just lambda because of GCC-8 bug
-// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=86740
-template<typename ArrowType, typename T>
-struct AbominableGroupingIterator
+template<typename T>
+struct GroupedStdDev : GroupedVariance<T>
 {
-    int64_t row = 0;
+    using GroupedVariance<T>::GroupedVariance;
+    double get(int64_t group) { return std::sqrt(GroupedVariance<T>::get(group)); }
+};
 
-    GroupedKeyInfo<ArrowType> &groups;
-    std::vector<Aggregators<T>> &aggregators;
+// Values are placed in a single buffer, each group in its own segment. Not mergeable, see aggregateGroups.
+template<typename T>
+struct GroupedMedian
+{
+    std::vector<int64_t> offsets;
+    std::vector<int64_t> cursors;
+    std::vector<T> values;
+    GroupedMedian(const std::vector<int64_t> &validCounts)
+        : offsets(validCounts.size() + 1)
+    {
+        std::partial_sum(validCounts.begin(), validCounts.end(), offsets.begin() + 1);
+        cursors.assign(offsets.begin(), offsets.end() - 1);
+        values.resize(offsets.back());
+    }
+    void add(int64_t group, T value) { values[cursors[group]++] = value; }
+    double get(int64_t group) { return rangeQuantile(values.begin() + offsets[group], values.begin() + offsets[group + 1]); }
+};
 
-    AbominableGroupingIterator(GroupedKeyInfo<ArrowType> &groups, std::vector<Aggregators<T>> &aggregators)
-            : groups(groups), aggregators(aggregators)
-    {}
+template<typename T>
+struct GroupedFirst
+{
+    std::vector<T> values;
+    std::vector<uint8_t> seen;
+    GroupedFirst(const std::vector<int64_t> &validCounts) : values(validCounts.size()), seen(validCounts.size()) {}
+    void add(int64_t group, T value)
+    {
+        if(!seen[group])
+        {
+            seen[group] = true;
+            values[group] = value;
+        }
+    }
+    void merge(const GroupedFirst &other, int64_t group)
+    {
+        if(other.seen[group])
+            add(group, other.values[group]);
+    }
+    double get(int64_t group) { return values[group]; }
+};
 
-    template <typename U>
-    void operator()(U value)
+template<typename T>
+struct GroupedLast
+{
+    std::vector<T> values;
+    std::vector<uint8_t> seen;
+    GroupedLast(const std::vector<int64_t> &validCounts) : values(validCounts.size()), seen(validCounts.size()) {}
+    void add(int64_t group, T value)
     {
-        const auto groupId = groups.groupIds[row++];
-        aggregators[groupId](value);
+        seen[group] = true;
+        values[group] = value;
     }
-    void operator()()
+    void merge(const GroupedLast &other, int64_t group)
     {
-        const auto groupId = groups.groupIds[row++];
-        aggregators[groupId]();
+        if(other.seen[group])
+            add(group, other.values[group]);
     }
+    double get(int64_t group) { return values[group]; }
 };
 
-std::string to_string(AggregateFunction a)
+template<typename T>
+struct GroupedRSI
 {
-    return dispatchAggregateByEnum(a, [] (auto aggrC) { return AggregatorFor_t<aggrC.value, double>::name; });
+    std::vector<T> ups;
+    std::vector<T> downs;
+    GroupedRSI(const std::vector<int64_t> &validCounts) : ups(validCounts.size()), downs(validCounts.size()) {}
+    void add(int64_t group, T value)
+    {
+        ups[group] += std::max<T>(value, 0.0);
+        downs[group] += std::min<T>(0.0, value);
+    }
+    void merge(const GroupedRSI &other, int64_t group)
+    {
+        ups[group] += other.ups[group];
+        downs[group] += other.downs[group];
+    }
+    // the means' common denominator cancels out
+    double get(int64_t group) { return 100.0 * ups[group] / ((double)ups[group] - downs[group]); }
+};
+
+// Sketches are merged, so approximate medians of large columns are computed in parallel too.
+template<typename T>
+struct GroupedApproximateMedian
+{
+    std::vector<QuantileSketch> sketches;
+    GroupedApproximateMedian(const std::vector<int64_t> &validCounts) : sketches(validCounts.size()) {}
+    void add(int64_t group, T value)
+    {
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(value))
+                return;
+        sketches[group].add(value);
+    }
+    void merge(const GroupedApproximateMedian &other, int64_t group) { sketches[group].merge(other.sketches[group]); }
+    double get(int64_t group) { return sketches[group].quantile(0.5); }
+};
+
+template<AggregateFunction aggr, typename T>
+struct GroupedAggregatorFor {};
+
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Minimum, T> { using type = GroupedMinimum<T>; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Maximum, T> { using type = GroupedMaximum<T>; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Mean   , T> { using type = GroupedMean<T>   ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Median , T> { using type = GroupedMedian<T> ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::First  , T> { using type = GroupedFirst<T>  ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Last   , T> { using type = GroupedLast<T>   ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::Sum    , T> { using type = GroupedSum<T>    ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::RSI    , T> { using type = GroupedRSI<T>    ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::StdDev , T> { using type = GroupedStdDev<T> ; };
+template<typename T> struct GroupedAggregatorFor<AggregateFunction::ApproximateMedian, T> { using type = GroupedApproximateMedian<T>; };
+
+// Rows going into a single partial state when aggregating in parallel.
+constexpr int64_t MinimumRowsPerPartial = 1 << 16;
+// Groups merged (or calculated) by a single task.
+constexpr int64_t MinimumGroupsPerTask = 1 << 12;
+
+template<typename Grouped, typename T>
+void addRows(Grouped &state, const std::vector<T> &values, const std::vector<uint8_t> &valid, const std::vector<int64_t> &groupIds, int64_t begin, int64_t end)
+{
+    for(int64_t row = begin; row < end; ++row)
+    {
+        const auto group = groupIds[row];
+        if(group >= 0 && valid[row])
+            state.add(group, values[row]);
+    }
 }
 
-DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(std::shared_ptr<arrow::Column> keyColumn, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate)
+// Feeds valid values to grouped state. Large columns are split into row ranges aggregated in
+// parallel into partial states. Every partial has arrays for all groups, so it is done only when
+// there are few groups compared to rows.
+template<typename Grouped, typename T>
+Grouped aggregateGroups(const std::vector<T> &values, const std::vector<uint8_t> &valid, const std::vector<int64_t> &groupIds, const std::vector<int64_t> &validCounts)
 {
-    std::vector<std::shared_ptr<arrow::Column>> newColumns;
+    const int64_t N = values.size();
+    const int64_t groupCount = validCounts.size();
+    Grouped state{validCounts};
 
-    visitDataType(keyColumn->type(), [&](auto type)
+    const auto rangeCount = parallelRangeCount(N, MinimumRowsPerPartial);
+    if(rangeCount <= 1 || groupCount * rangeCount > N)
     {
-        using ArrowType = ArrowTypeFromPtr<decltype(type)>;
-        constexpr auto keyTypeID = idFromDataPointer<decltype(type)>;
-        using KeyT = typename TypeDescription<keyTypeID>::ObservedType;
-        if constexpr(keyTypeID == arrow::Type::LIST)
+        addRows(state, values, valid, groupIds, 0, N);
+        return state;
+    }
+
+    const auto groupRangeCount = parallelRangeCount(groupCount, MinimumGroupsPerTask);
+    if constexpr(std::is_same_v<Grouped, GroupedMedian<T>>)
+    {
+        // Partition: each range counts its values in every group, so it knows where in group's
+        // segment it can place them. Selection is done later, separately for each group.
+        std::vector<std::vector<int64_t>> cursors(rangeCount);
+        parallelForRanges(N, rangeCount, [&] (int64_t rangeIndex, int64_t begin, int64_t end)
         {
-            throw std::runtime_error("not implemented: grouping by column of list type");
-        }
-        else
+            auto &counts = cursors[rangeIndex];
+            counts.resize(groupCount);
+            for(int64_t row = begin; row < end; ++row)
+                if(const auto group = groupIds[row]; group >= 0 && valid[row])
+                    ++counts[group];
+        });
+        parallelForRanges(groupCount, groupRangeCount, [&] (int64_t, int64_t begin, int64_t end)
         {
-            GroupedKeyInfo<ArrowType> groups{*keyColumn};
+            for(int64_t group = begin; group < end; ++group)
+            {
+                auto position = state.offsets[group];
+                for(auto &rangeCursors : cursors)
+                {
+                    const auto count = rangeCursors[group];
+                    rangeCursors[group] = position;
+                    position += count;
+                }
+            }
+        });
+        parallelForRanges(N, rangeCount, [&] (int64_t rangeIndex, int64_t begin, int64_t end)
+        {
+            auto &rangeCursors = cursors[rangeIndex];
+            for(int64_t row = begin; row < end; ++row)
+                if(const auto group = groupIds[row]; group >= 0 && valid[row])
+                    state.values[rangeCursors[group]++] = values[row];
+        });
+    }
+    else
+    {
+        // the first range goes directly to the result
+        std::vector<Grouped> partials;
+        partials.reserve(rangeCount - 1);
+        for(int64_t i = 1; i < rangeCount; ++i)
+            partials.emplace_back(validCounts);
 
-            const auto groupCount = groups.groupCount();
-            const auto hasNulls = groups.hasNulls;
-            const auto afterLastGroup = groups.uniqueValues.size()+1;
+        parallelForRanges(N, rangeCount, [&] (int64_t rangeIndex, int64_t begin, int64_t end)
+        {
+            auto &target = rangeIndex ? partials[rangeIndex - 1] : state;
+            addRows(target, values, valid, groupIds, begin, end);
+        });
+        parallelForRanges(groupCount, groupRangeCount, [&] (int64_t, int64_t begin, int64_t end)
+        {
+            for(auto &partial : partials)
+                for(int64_t group = begin; group < end; ++group)
+                    state.merge(partial, group);
+        });
+    }
+    return state;
+}
+
+// Computes a single function for all groups: values of non-arithmetic columns are not read
+// (and only Length is allowed for them). Group gets null if it had no valid value, unless the
+// function doesn't need any.
+// Cannot be just lambda because of GCC-8 bug
+// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=86740
+template<typename T>
+struct GroupAggregateCalculator
+{
+    const std::vector<T> &values;
+    const std::vector<uint8_t> &valid;
+    const std::vector<int64_t> &groupIds;
+    const std::vector<int64_t> &rowCounts;
+    const std::vector<int64_t> &validCounts;
 
-            std::vector<KeyT> keyValues(afterLastGroup);
-            for(auto [keyValue, groupId] : groups.uniqueValues)
-                keyValues[groupId] = keyValue;
+    template <AggregateFunction f>
+    std::shared_ptr<arrow::Array> operator()(std::integral_constant<AggregateFunction, f>) const
+    {
+        const int64_t groupCount = validCounts.size();
+        arrow::DoubleBuilder builder;
+        builder.Reserve(groupCount);
+
+        if constexpr(f == AggregateFunction::Length)
+        {
+            for(int64_t group = 0; group < groupCount; ++group)
+                builder.Append(rowCounts[group]);
+        }
+        else if constexpr(doesAggregatorAllowsType<T>(f))
+        {
+            using Grouped = typename GroupedAggregatorFor<f, T>::type;
+            auto state = aggregateGroups<Grouped>(values, valid, groupIds, validCounts);
 
-            // build column with unique key values
+            // groups are independent (and median's selection is the costly part)
+            constexpr auto requiredCount = AggregatorFor_t<f, T>::RequiredSampleCount;
+            std::vector<double> results(groupCount);
+            parallelForRanges(groupCount, parallelRangeCount(groupCount, MinimumGroupsPerTask), [&] (int64_t, int64_t begin, int64_t end)
             {
-                auto builder = makeBuilder(type);
-                if(hasNulls)
-                    builder->AppendNull();
-                for(int group = 1; group < keyValues.size(); ++group)
-                    append(*builder, keyValues[group]);
-
-                auto arr = finish(*builder);
-                newColumns.push_back(std::make_shared<arrow::Column>(keyColumn->field(), arr));
-            }
+                for(int64_t group = begin; group < end; ++group)
+                    if(validCounts[group] || !requiredCount)
+                        results[group] = state.get(group);
+            });
 
-            // build column for each (column, aggregate function) pair
-            for(auto &colAggrs : toAggregate)
+            for(int64_t group = 0; group < groupCount; ++group)
             {
-                visitType(colAggrs.first->type()->id(), [&](auto id)
-                {
-                    auto [column, aggregates] = colAggrs;
-                    using T = typename TypeDescription<id.value>::ObservedType;
-                    std::vector<Aggregators<T>> aggregators;
-                    aggregators.reserve(afterLastGroup);
-                    for(int i = 0; i < afterLastGroup; i++)
-                    {
-                        try
-                        {
-                            aggregators.emplace_back(aggregates);
-                        }
-                        catch(std::exception &e)
-                        {
-                            THROW("cannot aggregate for column `{}` of type `{}`: {}", column->name(), column->type()->ToString(), e);
-                        }
-                    }
-
-                    AbominableGroupingIterator<ArrowType, T> iterator{groups, aggregators};
-                    iterateOver<id.value>(*column, iterator, iterator);
-
-                    std::vector<arrow::DoubleBuilder> newColumnBuilders(aggregates.size());
-                    for(auto &&newColumnBuilder : newColumnBuilders)
-                        newColumnBuilder.Reserve(groupCount);
-
-                    for(int64_t groupItr = !hasNulls; groupItr < afterLastGroup; ++groupItr)
-                    {
-                        auto &aggr = aggregators[groupItr];
-                        for(int32_t i = 0; i < aggregates.size(); i++)
-                        {
-                            if(auto result = aggr.aggregators[i]->get(aggr.hadValidValue))
-                                newColumnBuilders[i].Append(*result);
-                            else
-                                newColumnBuilders[i].AppendNull();
-                        }
-                    }
-                    for(int32_t i = 0; i < aggregates.size(); i++)
-                    {
-                        auto arr = finish(newColumnBuilders[i]);
-                        auto col = toColumn(arr, column->name() + "_"s + aggregateName(aggregates[i]));
-                        newColumns.push_back(col);
-                    };
-                });
+                if(validCounts[group] || !requiredCount)
+                    builder.Append(results[group]);
+                else
+                    builder.AppendNull();
             }
         }
-    });
+        else
+            THROW("wrong type for function id={}", (int)f);
 
+        return finish(builder);
+    }
+};
 
+std::string to_string(AggregateFunction a)
+{
+    return dispatchAggregateByEnum(a, [] (auto aggrC) { return AggregatorFor_t<aggrC.value, double>::name; });
+}
 
-    return tableFromColumns(newColumns);
+DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(std::shared_ptr<arrow::Column> keyColumn, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate)
+{
+    return abominableGroupAggregate(std::vector<std::shared_ptr<arrow::Column>>{ keyColumn }, std::move(toAggregate));
 }
 
-template<class TD>
-using IntervalType = typename TD::IntervalType;
+DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(const std::vector<std::shared_ptr<arrow::Column>> &keyColumns, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate)
+{
+    return abominableGroupAggregate(keyColumns, std::move(toAggregate), nullptr);
+}
 
-template<arrow::Type::type id, typename Indexable, typename Index>
-std::optional<typename TypeDescription<id>::ObservedType> getMaybeValue(const Indexable &indexable, Index index)
+DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(const std::vector<std::shared_ptr<arrow::Column>> &keyColumns, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, const arrow::Buffer *rowMask)
 {
-    if constexpr(std::is_same_v<Indexable, arrow::Column>)
-    {
-        return getMaybeValue<id>(*indexable.data(), index);
-    }
-    else if constexpr(std::is_same_v<Indexable, arrow::ChunkedArray>)
-    {
-        auto [chunk, chunkIndex] = locateChunk(indexable, index);
-        return getMaybeValue<id>(*chunk, index);
-    }
-    else if constexpr(std::is_same_v<Indexable, arrow::Array>)
+    for(auto &keyColumn : keyColumns)
+        if(keyColumn->type()->id() == arrow::Type::LIST)
+            throw std::runtime_error("not implemented: grouping by column of list type");
+
+    std::vector<std::shared_ptr<arrow::Column>> newColumns;
+
+    // rows outside of the mask are skipped, so filtered columns never need to be materialized
+    // equal keys of a sorted column are adjacent, so each run of them is a group
+    auto allGroups = keyColumns.size() == 1 && isKnownSorted(*keyColumns.front())
+        ? groupRuns(*keyColumns.front())
+        : groupRows(keyColumns);
+    const auto groups = rowMask
+        ? selectRows(allGroups, rowMask->data())
+        : std::move(allGroups);
+    const auto groupCount = groups.groupCount;
+
+    // build columns with unique key values
+    for(auto &keyColumn : keyColumns)
+        newColumns.push_back(std::make_shared<arrow::Column>(gatheredField(*keyColumn, groups.firstRows), permuteToArray(keyColumn, groups.firstRows)));
+
+    // rows of each group, including null ones
+    std::vector<int64_t> rowCounts(groupCount);
+    for(auto groupId : groups.groupIds)
+        if(groupId >= 0)
+            ++rowCounts[groupId];
+
+    // build column for each (column, aggregate function) pair
+    for(auto &colAggrs : toAggregate)
     {
-        if(indexable.IsValid(index))
-            return arrayValueAt<id>(indexable, index);
-        else
-            return std::nullopt;
+        visitType(colAggrs.first->type()->id(), [&](auto id)
+        {
+            auto [column, aggregates] = colAggrs;
+            using T = typename TypeDescription<id.value>::ObservedType;
+
+            // values are read once and then go through a tight loop for each function
+            std::vector<T> values;
+            std::vector<uint8_t> valid;
+            valid.reserve(column->length());
+            if constexpr(std::is_arithmetic_v<T>)
+            {
+                values.reserve(column->length());
+                iterateOver<id.value>(*column,
+                    [&] (T value) { values.push_back(value); valid.push_back(1); },
+                    [&] () { values.push_back(T{}); valid.push_back(0); });
+            }
+            else
+            {
+                iterateOver<id.value>(*column,
+                    [&] (auto &&) { valid.push_back(1); },
+                    [&] () { valid.push_back(0); });
+            }
+
+            std::vector<int64_t> validCounts(groupCount);
+            for(int64_t row = 0; row < (int64_t)valid.size(); ++row)
+                if(const auto groupId = groups.groupIds[row]; groupId >= 0)
+                    validCounts[groupId] += valid[row];
+
+            const GroupAggregateCalculator<T> calculator{values, valid, groups.groupIds, rowCounts, validCounts};
+            for(auto aggregate : aggregates)
+            {
+                try
+                {
+                    auto arr = dispatchAggregateByEnum(aggregate, calculator);
+                    newColumns.push_back(toColumn(arr, column->name() + "_"s + to_string(aggregate)));
+                }
+                catch(std::exception &e)
+                {
+                    THROW("cannot aggregate for column `{}` of type `{}`: {}", column->name(), column->type()->ToString(), e);
+                }
+            }
+        });
     }
-    else
-        static_assert(always_false_v<Indexable>);
+
+    return tableFromColumns(newColumns);
 }
 
+template<class TD>
+using IntervalType = typename TD::IntervalType;
+
 template<arrow::Type::type id, typename Indexable>
 auto getJustValue(const Indexable &indexable, int64_t index)
 {
@@ -804,54 +1604,413 @@ std::vector<int64_t> collectRollingWindowPositionsT(const Indexable &indexable,
     return ret;
 }
 
-// because of GCC-8 bug this cannot be lambda
-// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=86740
-template <typename Indexable, arrow::Type::type id>
-struct FunctionOverWindowCalculator
+// Aggregation over sliding windows. Both ends of consecutive windows only move forward, so every
+// row enters and leaves the window once and aggregators are updated incrementally instead of
+// going over the whole window for each row. Aggregators are told about valid rows only, and about
+// rows leaving the window in the same order as they entered it.
+
+// Sum of values entering and leaving the window. Non-finite doubles are counted aside (so one
+// infinity passing through doesn't leave NaN behind), finite ones are summed with compensation,
+// so subtracting doesn't accumulate rounding errors.
+template<typename T>
+struct WindowSum
 {
-    const Indexable &indexable;
-    int64_t startIndex;
-    int64_t windowsWidth;
+    T sum{};
+    T compensation{};
+    int64_t nanCount = 0;
+    int64_t positiveInfinityCount = 0;
+    int64_t negativeInfinityCount = 0;
 
-    template <AggregateFunction f>
-    std::optional<double> operator()(std::integral_constant<AggregateFunction, f> aggrC) const
+    void add(T value, int64_t multiplicity = 1)
     {
-        using T = typename TypeDescription<id>::ValueType;
-        using Aggregator = AggregatorFor_t<aggrC.value, T>;
-        Aggregator aggregator;
-
-        auto validCount = 0;
-        for(int64_t row = startIndex - windowsWidth + 1; row <= startIndex; ++row)
+        if constexpr(std::is_floating_point_v<T>)
         {
-            const auto value = getMaybeValue<id>(indexable, row);
-            if(value)
+            if(std::isnan(value))
+                nanCount += multiplicity;
+            else if(std::isinf(value))
+                (value > 0 ? positiveInfinityCount : negativeInfinityCount) += multiplicity;
+            else
             {
-                ++validCount;
-                aggregator(*value);
+                // Neumaier summation
+                const T term = multiplicity * value;
+                const T newSum = sum + term;
+                compensation += std::abs(sum) >= std::abs(term) ? (sum - newSum) + term : (term - newSum) + sum;
+                sum = newSum;
             }
-            else
-                aggregator();
         }
-        if(validCount >= Aggregator::RequiredSampleCount)
-            return aggregator.get();
         else
-            return std::nullopt;
+            sum += multiplicity * value;
+    }
+    void remove(T value) { add(value, -1); }
+
+    T get() const
+    {
+        if constexpr(std::is_floating_point_v<T>)
+        {
+            if(nanCount || (positiveInfinityCount && negativeInfinityCount))
+                return std::numeric_limits<T>::quiet_NaN();
+            if(positiveInfinityCount)
+                return std::numeric_limits<T>::infinity();
+            if(negativeInfinityCount)
+                return -std::numeric_limits<T>::infinity();
+            return sum + compensation;
+        }
+        else
+            return sum;
     }
 };
 
-template<typename Indexable>
-std::optional<double> calculateFunctionOnWindow(const Indexable &indexable, int64_t startIndex, int64_t windowsWidth, AggregateFunction f)
+template<typename T>
+struct SlidingSum
+{
+    const std::vector<T> &values;
+    WindowSum<T> sum;
+
+    void add(int64_t row) { sum.add(values[row]); }
+    void remove(int64_t row) { sum.remove(values[row]); }
+    double get(int64_t, int64_t) const { return sum.get(); }
+};
+
+template<typename T>
+struct SlidingMean
 {
-    return visitType4(indexable.type(), [&] (auto id) -> std::optional<double>
+    const std::vector<T> &values;
+    WindowSum<T> sum;
+    int64_t count = 0;
+
+    void add(int64_t row) { sum.add(values[row]); ++count; }
+    void remove(int64_t row) { sum.remove(values[row]); --count; }
+    double get(int64_t, int64_t) const { return sum.get() / (double)count; }
+};
+
+// Population variance, Welford's algorithm extended with removal.
+template<typename T>
+struct SlidingVariance
+{
+    const std::vector<T> &values;
+    int64_t count = 0;
+    int64_t nonFiniteCount = 0;
+    double mean = 0;
+    double m2 = 0; // sum of squared differences from the mean
+    // Removals leave rounding residue in m2, so equal values are tracked to give exact 0 for them.
+    double lastValue = 0;
+    int64_t lastValueRun = 0; // number of most recently added values equal to lastValue
+
+    void add(int64_t row)
     {
-        if constexpr(id.value == arrow::Type::INT64 || id.value == arrow::Type::DOUBLE)
+        const double value = values[row];
+        if(!std::isfinite(value))
+        {
+            ++nonFiniteCount;
+            return;
+        }
+
+        lastValueRun = lastValueRun && value == lastValue ? lastValueRun + 1 : 1;
+        lastValue = value;
+        ++count;
+        const auto delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+    void remove(int64_t row)
+    {
+        const double value = values[row];
+        if(!std::isfinite(value))
+        {
+            --nonFiniteCount;
+            return;
+        }
+
+        if(--count == 0)
         {
-            FunctionOverWindowCalculator<Indexable, id.value> calculator{indexable, startIndex, windowsWidth};
-            return dispatchAggregateByEnum(f, calculator);
+            mean = m2 = 0;
+            return;
         }
+        const auto delta = value - mean;
+        mean -= delta / count;
+        m2 -= delta * (value - mean);
+    }
+    double get(int64_t, int64_t) const
+    {
+        if(nonFiniteCount)
+            return std::numeric_limits<double>::quiet_NaN();
+        if(lastValueRun >= count)
+            return 0;
+        return std::max(m2, 0.0) / count;
+    }
+};
+
+template<typename T>
+struct SlidingStdDev : SlidingVariance<T>
+{
+    double get(int64_t begin, int64_t end) const { return std::sqrt(SlidingVariance<T>::get(begin, end)); }
+};
+
+// Monotonic queue of rows: values of the rows are increasing (for minimum), so the front is the
+// extreme of the window, and every row is pushed and popped at most once. NaNs are skipped.
+template<typename T, typename Compare>
+struct SlidingExtreme
+{
+    const std::vector<T> &values;
+    std::deque<int64_t> rows;
+
+    void add(int64_t row)
+    {
+        const auto value = values[row];
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(value))
+                return;
+
+        // rows that are not better than the new one will never be the extreme again
+        while(!rows.empty() && !Compare{}(values[rows.back()], value))
+            rows.pop_back();
+        rows.push_back(row);
+    }
+    void remove(int64_t row)
+    {
+        if(!rows.empty() && rows.front() == row)
+            rows.pop_front();
+    }
+    double get(int64_t, int64_t) const
+    {
+        return rows.empty() ? std::numeric_limits<double>::quiet_NaN() : values[rows.front()];
+    }
+};
+
+template<typename T> using SlidingMinimum = SlidingExtreme<T, std::less<T>>;
+template<typename T> using SlidingMaximum = SlidingExtreme<T, std::greater<T>>;
+
+// Window values split into two sorted halves, the lower one having the extra element for
+// odd counts, so the median is found at their boundary. NaNs are skipped.
+template<typename T>
+struct SlidingMedian
+{
+    const std::vector<T> &values;
+    std::multiset<T> lower, upper;
+
+    void add(int64_t row)
+    {
+        const auto value = values[row];
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(value))
+                return;
+
+        if(lower.empty() || !(*lower.rbegin() < value))
+            lower.insert(value);
         else
-            throw std::runtime_error("rolling statistics not supported for type " + indexable.type()->ToString());
-    });
+            upper.insert(value);
+        rebalance();
+    }
+    void remove(int64_t row)
+    {
+        const auto value = values[row];
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(value))
+                return;
+
+        if(!(*lower.rbegin() < value))
+            lower.erase(lower.find(value));
+        else
+            upper.erase(upper.find(value));
+        rebalance();
+    }
+    void rebalance()
+    {
+        if(lower.size() > upper.size() + 1)
+        {
+            upper.insert(*lower.rbegin());
+            lower.erase(std::prev(lower.end()));
+        }
+        else if(upper.size() > lower.size())
+        {
+            lower.insert(*upper.begin());
+            upper.erase(upper.begin());
+        }
+    }
+    double get(int64_t, int64_t) const
+    {
+        if(lower.empty())
+            return std::numeric_limits<double>::quiet_NaN();
+        if(lower.size() > upper.size())
+            return *lower.rbegin();
+        return lerp<double>(*lower.rbegin(), *upper.begin(), 0.5);
+    }
+};
+
+// Sketch can't forget values, so it is used only for windows that never lose rows (for other
+// windows, median of values that are in memory anyway is calculated exactly). NaNs are skipped.
+template<typename T>
+struct SlidingApproximateMedian
+{
+    const std::vector<T> &values;
+    QuantileSketch sketch;
+
+    void add(int64_t row)
+    {
+        if constexpr(std::is_floating_point_v<T>)
+            if(std::isnan(values[row]))
+                return;
+        sketch.add(values[row]);
+    }
+    void remove(int64_t)
+    {
+        THROW("values cannot be removed from quantile sketch");
+    }
+    double get(int64_t, int64_t)
+    {
+        return sketch.quantile(0.5);
+    }
+};
+
+// Valid rows currently in the window, for first / last.
+template<typename T, bool first>
+struct SlidingEnd
+{
+    const std::vector<T> &values;
+    std::deque<int64_t> rows;
+
+    void add(int64_t row) { rows.push_back(row); }
+    void remove(int64_t) { rows.pop_front(); }
+    double get(int64_t, int64_t) const { return values[first ? rows.front() : rows.back()]; }
+};
+
+template<typename T>
+struct SlidingLength
+{
+    const std::vector<T> &values;
+
+    void add(int64_t) {}
+    void remove(int64_t) {}
+    double get(int64_t begin, int64_t end) const { return end - begin; } // nulls count too
+};
+
+template<typename T>
+struct SlidingRSI
+{
+    const std::vector<T> &values;
+    WindowSum<T> up, down;
+    int64_t count = 0;
+
+    void add(int64_t row)
+    {
+        up.add(std::max<T>(values[row], 0.0));
+        down.add(std::min<T>(0.0, values[row]));
+        ++count;
+    }
+    void remove(int64_t row)
+    {
+        up.remove(std::max<T>(values[row], 0.0));
+        down.remove(std::min<T>(0.0, values[row]));
+        --count;
+    }
+    double get(int64_t, int64_t) const
+    {
+        const auto upMean = up.get() / (double)count;
+        const auto downMean = down.get() / (double)count;
+        return 100.0 * upMean / (upMean - downMean);
+    }
+};
+
+template<AggregateFunction aggr, typename T>
+struct SlidingAggregatorFor {};
+
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Minimum, T> { using type = SlidingMinimum<T>  ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Maximum, T> { using type = SlidingMaximum<T>  ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Mean   , T> { using type = SlidingMean<T>     ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Length , T> { using type = SlidingLength<T>   ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Median , T> { using type = SlidingMedian<T>   ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::First  , T> { using type = SlidingEnd<T, true> ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Last   , T> { using type = SlidingEnd<T, false>; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::Sum    , T> { using type = SlidingSum<T>      ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::RSI    , T> { using type = SlidingRSI<T>      ; };
+template<typename T> struct SlidingAggregatorFor<AggregateFunction::StdDev , T> { using type = SlidingStdDev<T>   ; };
+
+// Window of each row is [starts[row], ends[row]), windows' starts and ends must not decrease.
+// Rows where window has fewer valid values than minPeriods or than the aggregate function needs get null.
+struct RollingWindows
+{
+    std::vector<int64_t> starts;
+    std::vector<int64_t> ends;
+    int64_t minPeriods = 0;
+};
+
+// because of GCC-8 bug this cannot be lambda
+// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=86740
+template<typename T>
+struct SlidingWindowCalculator
+{
+    const std::vector<T> &values;
+    const std::vector<uint8_t> &valid;
+    const RollingWindows &windows;
+
+    template <AggregateFunction f>
+    std::shared_ptr<arrow::Array> operator()(std::integral_constant<AggregateFunction, f>) const
+    {
+        const auto requiredCount = std::max<int64_t>(AggregatorFor_t<f, T>::RequiredSampleCount, windows.minPeriods);
+        if constexpr(f == AggregateFunction::ApproximateMedian)
+        {
+            // starts don't decrease, so the last one tells if all windows start at the first row
+            if(windows.starts.empty() || windows.starts.back() == 0)
+                return slide<SlidingApproximateMedian<T>>(requiredCount);
+            return slide<SlidingMedian<T>>(requiredCount);
+        }
+        else
+            return slide<typename SlidingAggregatorFor<f, T>::type>(requiredCount);
+    }
+
+    template<typename Aggregator>
+    std::shared_ptr<arrow::Array> slide(int64_t requiredCount) const
+    {
+        Aggregator aggregator{values};
+
+        const int64_t N = values.size();
+        arrow::DoubleBuilder builder;
+        builder.Reserve(N);
+
+        int64_t begin = 0;
+        int64_t end = 0;
+        int64_t validCount = 0;
+        for(int64_t row = 0; row < N; ++row)
+        {
+            for(; end < windows.ends[row]; ++end)
+            {
+                if(valid[end])
+                {
+                    aggregator.add(end);
+                    ++validCount;
+                }
+            }
+            for(; begin < windows.starts[row]; ++begin)
+            {
+                if(valid[begin])
+                {
+                    aggregator.remove(begin);
+                    --validCount;
+                }
+            }
+
+            if(validCount >= requiredCount)
+                builder.Append(aggregator.get(begin, end));
+            else
+                builder.AppendNull();
+        }
+        return finish(builder);
+    }
+};
+
+template<arrow::Type::type id>
+std::shared_ptr<arrow::Array> aggregateSlidingWindows(const arrow::Column &column, const RollingWindows &windows, AggregateFunction f)
+{
+    using T = typename TypeDescription<id>::ValueType;
+    std::vector<T> values;
+    std::vector<uint8_t> valid;
+    values.reserve(column.length());
+    valid.reserve(column.length());
+    iterateOver<id>(column,
+        [&] (T value) { values.push_back(value); valid.push_back(1); },
+        [&] () { values.push_back(T{}); valid.push_back(0); });
+
+    return dispatchAggregateByEnum(f, SlidingWindowCalculator<T>{values, valid, windows});
 }
 
 std::vector<int64_t> collectRollingIntervalSizes(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval)
@@ -878,41 +2037,106 @@ void requireSameSize(const arrow::Column &lhs, const arrow::Column &rhs)
         THROW("Column length mismatch: `{}` has {} rows, `{}` has {} rows", lhs.name(), lhsN, rhs.name(), rhsN);
 }
 
-std::shared_ptr<arrow::Table> rollingInterval(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate)
+// Columns with each function applied over the windows. Every (column, function) pair is computed independently.
+std::vector<std::shared_ptr<arrow::Column>> aggregateRollingWindows(const RollingWindows &windows, const std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> &toAggregate)
 {
-    std::vector<std::shared_ptr<arrow::Column>> newColumns{ keyColumn };
-
-    const auto N = keyColumn->length();
-    const auto windowWidths = collectRollingIntervalSizes(keyColumn, interval);
+    std::vector<std::pair<std::shared_ptr<arrow::Column>, AggregateFunction>> tasks;
     for(auto && [col, funcs] : toAggregate)
     {
-        requireSameSize(*keyColumn, *col);
-        dispatchIndexable(col, [&, &col=col, &funcs=funcs](auto &&indexable)
+        if(col->length() != (int64_t)windows.starts.size())
+            THROW("Column length mismatch: `{}` has {} rows, expected {}", col->name(), col->length(), windows.starts.size());
+        for(auto fun : funcs)
+            tasks.emplace_back(col, fun);
+    }
+
+    std::vector<std::shared_ptr<arrow::Column>> ret(tasks.size());
+    parallelFor(tasks.size(), [&] (int64_t i)
+    {
+        const auto &col = tasks[i].first;
+        const auto fun = tasks[i].second;
+        try
         {
-            const auto &name = col->name();
-            for(auto fun : funcs)
+            const auto arr = visitType(*col->type(), [&] (auto id) -> std::shared_ptr<arrow::Array>
             {
-                try
-                {
-                    arrow::DoubleBuilder builder;
-                    builder.Reserve(N);
+                if constexpr(id.value == arrow::Type::INT64 || id.value == arrow::Type::DOUBLE)
+                    return aggregateSlidingWindows<id.value>(*col, windows, fun);
+                else
+                    throw std::runtime_error("rolling statistics not supported for type " + col->type()->ToString());
+            });
+            ret[i] = toColumn(arr, col->name() + "_" + to_string(fun));  // TODO pretty name
+        }
+        catch(std::exception &e)
+        {
+            THROW("failed to calculate `{}` on column `{}`: {}", to_string(fun), col->name(), e);
+        }
+    });
+    return ret;
+}
 
-                    for(int64_t row = 0; row < N; ++row)
-                    {
-                        auto value = calculateFunctionOnWindow(*indexable, row, windowWidths[row], fun);
-                        append(builder, value);
-                    }
+int64_t rowCountOf(const std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> &toAggregate)
+{
+    if(toAggregate.empty())
+        THROW("no columns to aggregate");
 
-                    auto arr = finish(builder);
-                    newColumns.push_back(toColumn(arr, name + "_" + to_string(fun)));  // TODO pretty name
-                }
-                catch(std::exception &e)
-                {
-                    THROW("failed to calculate `{}` on column `{}`: {}", to_string(fun), name, e);
-                }
-            }
-        });
+    const auto &first = toAggregate.front().first;
+    for(auto && [col, funcs] : toAggregate)
+        requireSameSize(*first, *col);
+    return first->length();
+}
+
+std::shared_ptr<arrow::Table> rollingInterval(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate)
+{
+    const auto N = keyColumn->length();
+    const auto windowWidths = collectRollingIntervalSizes(keyColumn, interval);
+    RollingWindows windows;
+    windows.starts.resize(N);
+    windows.ends.resize(N);
+    for(int64_t row = 0; row < N; ++row)
+    {
+        windows.starts[row] = row + 1 - windowWidths[row];
+        windows.ends[row] = row + 1;
     }
 
+    for(auto && [col, funcs] : toAggregate)
+        requireSameSize(*keyColumn, *col);
+
+    auto newColumns = aggregateRollingWindows(windows, toAggregate);
+    newColumns.insert(newColumns.begin(), keyColumn);
     return tableFromColumns(newColumns);
-}
\ No newline at end of file
+}
+
+std::shared_ptr<arrow::Table> rollingRows(std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, int64_t windowSize, bool center, std::optional<int64_t> minPeriods)
+{
+    if(windowSize <= 0)
+        THROW("window size must be positive, got {}", windowSize);
+    if(minPeriods && *minPeriods < 0)
+        THROW("minimum number of periods must not be negative, got {}", *minPeriods);
+
+    const auto N = rowCountOf(toAggregate);
+    const auto after = center ? (windowSize - 1) / 2 : 0;
+    RollingWindows windows;
+    windows.starts.resize(N);
+    windows.ends.resize(N);
+    windows.minPeriods = minPeriods.value_or(windowSize);
+    for(int64_t row = 0; row < N; ++row)
+    {
+        const auto end = row + 1 + after;
+        windows.starts[row] = std::clamp<int64_t>(end - windowSize, 0, N);
+        windows.ends[row] = std::min(end, N);
+    }
+
+    return tableFromColumns(aggregateRollingWindows(windows, toAggregate));
+}
+
+std::shared_ptr<arrow::Table> expanding(std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, int64_t minPeriods)
+{
+    if(minPeriods < 0)
+        THROW("minimum number of periods must not be negative, got {}", minPeriods);
+
+    const auto N = rowCountOf(toAggregate);
+    RollingWindows windows;
+    windows.starts.assign(N, 0);
+    windows.ends = iotaVector<int64_t>(N, 1);
+    windows.minPeriods = minPeriods;
+    return tableFromColumns(aggregateRollingWindows(windows, toAggregate));
+}
@@ -8,7 +8,10 @@
 #include "Core/Common.h"
 #include "Core/ArrowUtilities.h"
 
-DFH_EXPORT std::shared_ptr<arrow::Table> countValues(const arrow::Column &column);
+// Table of distinct values ("value") with their occurrence counts ("count"), nulls are counted as one
+// more value. With topN given, only that many of the most frequent values are returned, starting from
+// the most frequent. Otherwise the order is unspecified.
+DFH_EXPORT std::shared_ptr<arrow::Table> countValues(const arrow::Column &column, std::optional<int64_t> topN = std::nullopt);
 
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateMin(const arrow::Column &column);
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateMax(const arrow::Column &column);
@@ -19,54 +22,35 @@ DFH_EXPORT std::shared_ptr<arrow::Column> calculateRSI(const arrow::Column &colu
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateStandardDeviation(const arrow::Column &column);
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateSum(const arrow::Column &column);
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateQuantile(const arrow::Column &column, double q);
+// Quantile is exact by default, which needs a copy of all values. With compression given it is
+// estimated in a single pass and bounded memory, see QuantileSketch. NaNs are skipped.
+DFH_EXPORT std::shared_ptr<arrow::Column> calculateQuantile(const arrow::Column &column, double q, std::optional<double> sketchCompression);
+// Exact quantiles for each q (a row for each), values are copied only once.
+DFH_EXPORT std::shared_ptr<arrow::Column> calculateQuantiles(const arrow::Column &column, const std::vector<double> &qs);
+// Summary of all columns, each is scanned once (columns in parallel). Result has a "statistic"
+// column naming the rows: count (of non-null values), null count, distinct (estimated, see
+// computeStatistics), min, max, mean, std dev and a row for each quantile. Then there is a double
+// column for each described one. Numeric statistics are null for non-numeric columns and for
+// columns without values, NaNs are skipped by them.
+DFH_EXPORT std::shared_ptr<arrow::Table> describeTable(const arrow::Table &table, const std::vector<double> &qs = {0.25, 0.5, 0.75});
 DFH_EXPORT double calculateCorrelation(const arrow::Column &xCol, const arrow::Column &yCol);
 DFH_EXPORT std::shared_ptr<arrow::Column> calculateCorrelation(const arrow::Table &table, const arrow::Column &column);
 DFH_EXPORT std::shared_ptr<arrow::Table> calculateCorrelationMatrix(const arrow::Table &table);
 
 DFH_EXPORT double autoCorrelation(const std::shared_ptr<arrow::Column> &column, int64_t lag = 1);
-
-template<typename ArrowType>
-struct GroupedKeyInfo
-{
-    using KeyT = typename ArrowTypeDescription<ArrowType>::ObservedType;
-    bool hasNulls;
-    std::unordered_map<KeyT, int64_t> uniqueValues; // key value => group id
-    std::vector<int64_t> groupIds; // [row index] => group id
-
-    explicit GroupedKeyInfo(const arrow::Column &keyColumn)
-        : hasNulls(keyColumn.null_count() != 0)
-        , groupIds(keyColumn.length())
-    {
-        auto *rowGroupId = groupIds.data();
-        iterateOver<ArrowType::type_id>(keyColumn, 
-            [&] (auto &&value)
-            {
-                if(auto itr = uniqueValues.find(value); itr != uniqueValues.end())
-                {
-                    *rowGroupId++ = itr->second;
-                }
-                else
-                {
-                    *rowGroupId++ = uniqueValues.emplace(value, uniqueValues.size() + 1).first->second;
-                }
-            },
-            [&] ()
-            {
-                *rowGroupId++ = 0;
-            });
-    }
-
-    int64_t groupCount() const
-    {
-        // Null is not included in unique values
-        return uniqueValues.size() + hasNulls;
-    }
-};
-
+// Autocorrelation function for lags 0..maxLag (a row for each): sum of products of deviations from
+// the mean that are lag rows apart, divided by the sum of squared deviations. Nulls and NaNs are
+// left out of the mean and of every product they would appear in, but rows are not shifted to
+// close the gaps. Unlike autoCorrelation, all lags are normalized alike (the usual ACF estimator).
+// All NaN if values have no variance.
+DFH_EXPORT std::shared_ptr<arrow::Column> autoCorrelations(const arrow::Column &column, int64_t maxLag);
 
 enum class AggregateFunction : int8_t
 {
-    Minimum, Maximum, Mean, Length, Median, First, Last, Sum, RSI, StdDev
+    Minimum, Maximum, Mean, Length, Median, First, Last, Sum, RSI, StdDev,
+    // Estimated with QuantileSketch, NaNs are skipped. Group and rolling aggregations always use
+    // QuantileSketch::DefaultCompression, only calculateQuantile takes a compression.
+    ApproximateMedian
 };
 
 template<typename Function>
@@ -84,6 +68,7 @@ auto dispatchAggregateByEnum(AggregateFunction aggregateEnum, Function &&f)
     CASE_DISPATCH(AggregateFunction::Sum)
     CASE_DISPATCH(AggregateFunction::RSI)
     CASE_DISPATCH(AggregateFunction::StdDev)
+    CASE_DISPATCH(AggregateFunction::ApproximateMedian)
     default: throw std::runtime_error("not supported aggregate function " + std::to_string((int)aggregateEnum));
     }
 }
@@ -91,6 +76,14 @@ auto dispatchAggregateByEnum(AggregateFunction aggregateEnum, Function &&f)
 DFH_EXPORT std::string to_string(AggregateFunction a);
 
 DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(std::shared_ptr<arrow::Column> keyColumn, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate);
+DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(const std::vector<std::shared_ptr<arrow::Column>> &keyColumns, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate);
+// Aggregates only rows with set bits in the mask (as if the table was filtered first). Null mask selects all rows.
+DFH_EXPORT std::shared_ptr<arrow::Table> abominableGroupAggregate(const std::vector<std::shared_ptr<arrow::Column>> &keyColumns, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, const arrow::Buffer *rowMask);
 
 DFH_EXPORT std::vector<int64_t> collectRollingIntervalSizes(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval);
-DFH_EXPORT std::shared_ptr<arrow::Table> rollingInterval(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate);
\ No newline at end of file
+DFH_EXPORT std::shared_ptr<arrow::Table> rollingInterval(std::shared_ptr<arrow::Column> keyColumn, DynamicField interval, std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate);
+// Windows of windowSize rows ending at each row or, when centered, extending (windowSize - 1) / 2 rows past it.
+// Windows with fewer than minPeriods valid values (by default: windowSize) give nulls.
+DFH_EXPORT std::shared_ptr<arrow::Table> rollingRows(std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, int64_t windowSize, bool center = false, std::optional<int64_t> minPeriods = std::nullopt);
+// Windows of all rows up to the given one.
+DFH_EXPORT std::shared_ptr<arrow::Table> expanding(std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> toAggregate, int64_t minPeriods = 1);
\ No newline at end of file
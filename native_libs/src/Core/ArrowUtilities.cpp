@@ -1,5 +1,7 @@
 #include "ArrowUtilities.h"
 
+#include <mutex>
+
 using namespace std::literals;
 
 //DFH_EXPORT std::shared_ptr<arrow::TimestampType> timestampTypeSingleton = std::make_shared<arrow::TimestampType>(arrow::TimeUnit::NANO);
@@ -132,6 +134,13 @@ std::shared_ptr<arrow::Table> tableFromColumns(const std::vector<std::shared_ptr
     return arrow::Table::Make(schema, tableColumns);
 }
 
+std::shared_ptr<arrow::Table> tableWithColumns(const arrow::Table &table, const std::vector<std::shared_ptr<arrow::Column>> &columns, int64_t rowCount)
+{
+    auto fields = transformToVector(columns, [](auto &&col) { return col->field(); });
+    auto schema = arrow::schema(fields, table.schema()->metadata());
+    return arrow::Table::Make(schema, columns, rowCount);
+}
+
 std::shared_ptr<arrow::Table> replaceColumn(const arrow::Table &table, const arrow::Column &columnToBeReplaced, std::shared_ptr<arrow::Column> replaceWith)
 {
     std::vector<std::shared_ptr<arrow::Column>> ret;
@@ -244,16 +253,52 @@ struct GetTypeS<std::shared_ptr<T>> { using type = T; };
 template<typename SharedPtrToType>
 using GetType = typename GetTypeS<std::decay_t<SharedPtrToType>>::type;
 
+namespace
+{
+    // larger requests get their own buffer, so the shared one doesn't pin lots of memory forever
+    constexpr int64_t MaxSharedZeroesSize = 4 << 20;
+
+    // View of `size` zero bytes. Memory for small sizes is allocated once and shared (growing when
+    // needed, up to MaxSharedZeroesSize), views are immutable so nobody can write to it.
+    std::shared_ptr<arrow::Buffer> zeroedBuffer(int64_t size)
+    {
+        if(size > MaxSharedZeroesSize)
+        {
+            auto [buffer, data] = allocateBuffer<uint8_t>(size);
+            std::memset(data, 0, buffer->size());
+            return arrow::SliceBuffer(buffer, 0, size);
+        }
+
+        static std::mutex mutex;
+        static std::shared_ptr<arrow::Buffer> zeroes;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if(!zeroes || zeroes->size() < size)
+        {
+            auto [buffer, data] = allocateBuffer<uint8_t>(std::max<int64_t>(size, 4096));
+            std::memset(data, 0, buffer->size());
+            zeroes = buffer;
+        }
+        return arrow::SliceBuffer(zeroes, 0, size);
+    }
+}
+
 std::shared_ptr<arrow::Array> makeNullsArray(TypePtr type, int64_t length)
 {
-    return visitDataType(type, [&](auto &&typeDer)
+    // Zeroes are valid contents for every buffer of an all-null array (bitmap, values, offsets),
+    // so there is no need to allocate nor to go through a builder.
+    const auto bitmap = zeroedBuffer(arrow::BitUtil::BytesForBits(length));
+    const auto offsets = [&] { return zeroedBuffer((length + 1) * sizeof(int32_t)); };
+    return visitDataType(type, [&](auto &&typeDer) -> std::shared_ptr<arrow::Array>
     {
         using Type = GetType<decltype(typeDer)>;
         static_assert(std::is_base_of_v<arrow::DataType, GetType<decltype(typeDer)>>);
-        auto builder = makeBuilder<Type>(typeDer);
-        for(int64_t i = 0; i < length; i++)
-            builder->AppendNull();
-        return finish(*builder);
+        if constexpr(std::is_same_v<Type, arrow::StringType>)
+            return std::make_shared<arrow::StringArray>(length, offsets(), zeroedBuffer(0), bitmap, length);
+        else if constexpr(std::is_same_v<Type, arrow::ListType>)
+            return std::make_shared<arrow::ListArray>(type, length, offsets(), makeNullsArray(typeDer->value_type(), 0), bitmap, length);
+        else
+            return std::make_shared<arrow::NumericArray<Type>>(type, length, zeroedBuffer(length * sizeof(typename Type::c_type)), bitmap, length);
     });
 }
 
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
@@ -674,6 +675,116 @@ struct DFH_EXPORT BitmaskGenerator
     void clear(int64_t index);
 };
 
+// mask with bitCount (<= 64) least significant bits set
+inline uint64_t lowBitsMask(int64_t bitCount)
+{
+    return bitCount >= 64 ? ~uint64_t(0) : (uint64_t(1) << bitCount) - 1;
+}
+
+// Reads bitCount (<= 64) consecutive bits of the bitmap, starting at arbitrary bit offset.
+// Bits are returned on the least significant positions, remaining bits are zero.
+// Note: assumes little-endian platform, as Arrow bitmaps are LSB-ordered.
+inline uint64_t loadBits(const uint8_t *bitmap, int64_t bitOffset, int64_t bitCount)
+{
+    if(bitCount <= 0)
+        return 0;
+
+    const uint8_t *bytes = bitmap + bitOffset / 8;
+    const auto shift = static_cast<int>(bitOffset % 8);
+    const auto bytesNeeded = (shift + bitCount + 7) / 8; // at most 9
+
+    uint64_t word = 0;
+    std::memcpy(&word, bytes, static_cast<size_t>(std::min<int64_t>(bytesNeeded, 8)));
+    word >>= shift;
+    if(bytesNeeded > 8)
+        word |= uint64_t(bytes[8]) << (64 - shift);
+
+    return word & lowBitsMask(bitCount);
+}
+
+// Validity bits of elements [index, index + count) of the array (count <= 64). Set bit means a valid value.
+inline uint64_t validityBits(const arrow::Array &array, int64_t index, int64_t count)
+{
+    const auto bitmap = array.null_bitmap_data();
+    if(bitmap == nullptr)
+        return lowBitsMask(count);
+    return loadBits(bitmap, array.offset() + index, count);
+}
+
+// Calls f(wordIndex, validityWord, bitCount) for each consecutive 64-element block of the chunked array.
+// Chunk boundaries don't need to be aligned to 64 elements - bits from adjacent chunks are stitched together,
+// so the n-th call always describes elements [64n, 64n + bitCount).
+template<typename F>
+void forEachValidityWord(const arrow::ChunkedArray &array, F &&f)
+{
+    int64_t wordIndex = 0;
+    uint64_t pending = 0;
+    int64_t pendingBits = 0;
+
+    for(auto &chunk : array.chunks())
+    {
+        const auto length = chunk->length();
+        const auto hasNulls = chunk->null_count() != 0;
+        for(int64_t position = 0; position < length; )
+        {
+            const auto n = std::min<int64_t>(64 - pendingBits, length - position);
+            const auto bits = hasNulls ? validityBits(*chunk, position, n) : lowBitsMask(n);
+            pending |= bits << pendingBits;
+            pendingBits += n;
+            position += n;
+            if(pendingBits == 64)
+            {
+                f(wordIndex++, pending, int64_t(64));
+                pending = 0;
+                pendingBits = 0;
+            }
+        }
+    }
+
+    if(pendingBits)
+        f(wordIndex, pending, pendingBits);
+}
+
+// Calls f(begin, end, valid) for each maximal run [begin, end) of array elements sharing the same validity.
+// Validity bitmap is scanned word by word, so long runs cost just a few operations per 64 elements.
+template<typename F>
+void forEachValidityRun(const arrow::Array &array, F &&f)
+{
+    const auto length = array.length();
+    if(length == 0)
+        return;
+
+    const auto nullCount = array.null_count();
+    if(nullCount == 0 || nullCount == length)
+    {
+        f(int64_t(0), length, nullCount == 0);
+        return;
+    }
+
+    int64_t runStart = 0;
+    bool runValid = array.IsValid(0);
+    for(int64_t wordStart = 0; wordStart < length; wordStart += 64)
+    {
+        const auto n = std::min<int64_t>(64, length - wordStart);
+        const auto bits = validityBits(array, wordStart, n);
+        int64_t position = 0;
+        while(true)
+        {
+            // bits that differ from the current run's validity mark where the next run starts
+            const auto boundaries = (runValid ? ~bits : bits) & lowBitsMask(n) & ~lowBitsMask(position);
+            if(boundaries == 0)
+                break;
+
+            position = countTrailingZeros(boundaries);
+            f(runStart, wordStart + position, runValid);
+            runStart = wordStart + position;
+            runValid = !runValid;
+        }
+    }
+
+    f(runStart, length, runValid);
+}
+
 std::shared_ptr<arrow::Field> setNullable(bool nullable, std::shared_ptr<arrow::Field> field);
 std::shared_ptr<arrow::Schema> setNullable(bool nullable, std::shared_ptr<arrow::Schema> field);
 
@@ -682,6 +793,9 @@ using PossiblyChunkedArray = variant<std::shared_ptr<arrow::Array>, std::shared_
 DFH_EXPORT std::shared_ptr<arrow::Table> tableFromArrays(std::vector<PossiblyChunkedArray> arrays, std::vector<std::string> names = {}, std::vector<bool> nullables = {});
 DFH_EXPORT std::shared_ptr<arrow::Table> tableFromColumns(const std::vector<std::shared_ptr<arrow::Column>> &columns, const std::shared_ptr<arrow::Schema> &schema);
 DFH_EXPORT std::shared_ptr<arrow::Table> tableFromColumns(const std::vector<std::shared_ptr<arrow::Column>> &columns);
+// Table made of given columns (in place of the table's ones), schema is taken from their fields.
+// Schema metadata of the table is kept.
+DFH_EXPORT std::shared_ptr<arrow::Table> tableWithColumns(const arrow::Table &table, const std::vector<std::shared_ptr<arrow::Column>> &columns, int64_t rowCount = -1);
 DFH_EXPORT std::shared_ptr<arrow::Table> replaceColumn(const arrow::Table &table, const arrow::Column &columnToBeReplaced, std::shared_ptr<arrow::Column> replaceWith);
 DFH_EXPORT std::shared_ptr<arrow::Table> replaceColumn(const arrow::Table &table, int index, std::shared_ptr<arrow::Column> column);
 
@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <string>
@@ -29,6 +30,41 @@ using namespace std::chrono_literals;
 #define NO_INLINE __attribute__((noinline))
 #endif
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+inline int popCount(uint64_t word)
+{
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// index of the least significant set bit, word must not be zero
+inline int countTrailingZeros(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// hints the CPU to start loading memory at address into cache
+inline void prefetch(const void *address)
+{
+#ifdef _MSC_VER
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    __builtin_prefetch(address);
+#endif
+}
+
 // intellisense is checked because of MSVC bug: https://developercommunity.visualstudio.com/content/problem/335672/c-intellisense-stops-working-with-given-code.html
 #if defined(_MSC_VER) && !defined(__INTELLISENSE__)
 #define EXPORT __declspec(dllexport)
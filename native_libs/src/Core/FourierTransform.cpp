@@ -0,0 +1,67 @@
+#include "FourierTransform.h"
+
+#include <cmath>
+
+namespace
+{
+    constexpr double Pi = 3.14159265358979323846;
+}
+
+FourierTransform::FourierTransform(int64_t size)
+    : length(size)
+{
+    if(size < 1 || (size & (size - 1)))
+        THROW("Fourier transform size must be a power of two, got {}", size);
+
+    // each twiddle computed directly, recurrences would accumulate rounding errors
+    twiddles.resize(size / 2);
+    for(int64_t k = 0; k < size / 2; k++)
+        twiddles[k] = std::polar(1.0, -2 * Pi * k / size);
+
+    int bits = 0;
+    while((int64_t(1) << bits) < size)
+        ++bits;
+    reversed.resize(size);
+    for(int64_t i = 1; i < size; i++)
+        reversed[i] = (reversed[i >> 1] >> 1) | ((i & 1) << (bits - 1));
+}
+
+void FourierTransform::forward(std::vector<std::complex<double>> &data) const
+{
+    transform(data, false);
+}
+
+void FourierTransform::backward(std::vector<std::complex<double>> &data) const
+{
+    transform(data, true);
+}
+
+void FourierTransform::transform(std::vector<std::complex<double>> &data, bool inverse) const
+{
+    if((int64_t)data.size() != length)
+        THROW("Fourier transform of size {} given {} values", length, data.size());
+
+    for(int64_t i = 0; i < length; i++)
+        if(i < reversed[i])
+            std::swap(data[i], data[reversed[i]]);
+
+    // butterflies of spans 2, 4, ..., N: twiddles of span s are every (N / s)-th of the full table
+    for(int64_t half = 1; half < length; half *= 2)
+    {
+        const auto stride = length / (2 * half);
+        for(int64_t start = 0; start < length; start += 2 * half)
+        {
+            for(int64_t j = 0; j < half; j++)
+            {
+                // multiplied by hand, std::complex operator* checks for NaNs and infinities
+                const auto re = twiddles[j * stride].real();
+                const auto im = inverse ? -twiddles[j * stride].imag() : twiddles[j * stride].imag();
+                auto &even = data[start + j];
+                auto &odd = data[start + j + half];
+                const std::complex<double> product{odd.real() * re - odd.imag() * im, odd.real() * im + odd.imag() * re};
+                odd = even - product;
+                even += product;
+            }
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+#include "Common.h"
+
+// Discrete Fourier transform of a fixed power-of-two size (iterative radix-2 Cooley-Tukey).
+// Twiddle factors and the bit-reversal permutation are computed once, so a single instance
+// is meant to transform many sequences of the same size. Transforms are done in place.
+class DFH_EXPORT FourierTransform
+{
+public:
+    explicit FourierTransform(int64_t size);
+
+    int64_t size() const { return length; }
+
+    // X[k] = sum of x[t] * exp(-2 pi i t k / N)
+    void forward(std::vector<std::complex<double>> &data) const;
+    // Inverse without the 1 / N normalization.
+    void backward(std::vector<std::complex<double>> &data) const;
+
+private:
+    int64_t length;
+    std::vector<std::complex<double>> twiddles; // exp(-2 pi i k / N) for k < N / 2
+    std::vector<int64_t> reversed; // [index] => index with reversed bits
+
+    void transform(std::vector<std::complex<double>> &data, bool inverse) const;
+};
@@ -0,0 +1,633 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "ArrowUtilities.h"
+#include "Parallel.h"
+
+// Hashing helpers and the machinery that splits rows into groups of equal keys.
+//
+// Keys are first read into a flat vector: fixed-width values become their normalized 64-bit
+// pattern, strings become views into the column's buffers. Then an open-addressing table assigns
+// dense ids to distinct keys. Large inputs are radix-partitioned by hash beforehand, so each
+// partition's table stays small enough to fit in cache (partitions are processed in parallel).
+
+inline uint64_t hashInteger(uint64_t x)
+{
+    // finalizer of MurmurHash3
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t hash)
+{
+    return hashInteger(seed ^ (hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+inline uint64_t hashBytes(const void *data, size_t length)
+{
+    auto bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = hashInteger(length);
+    for(; length >= 8; bytes += 8, length -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        hash = (hash ^ hashInteger(word)) * 0x9ddfea08eb382d69ULL;
+    }
+    if(length)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes, length);
+        hash = (hash ^ hashInteger(word)) * 0x9ddfea08eb382d69ULL;
+    }
+    return hashInteger(hash);
+}
+
+inline uint64_t hashKey(uint64_t key) { return hashInteger(key); }
+inline uint64_t hashKey(std::string_view key) { return hashBytes(key.data(), key.size()); }
+
+// Bit pattern of double that compares equal for values that should land in the same group:
+// both zeroes are the same key and so are all NaNs.
+inline uint64_t normalizedKeyBits(double value)
+{
+    if(value == 0)
+        value = 0;
+    else if(std::isnan(value))
+        value = std::numeric_limits<double>::quiet_NaN();
+
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// HyperLogLog sketch for estimating the number of distinct hashes.
+class DistinctCounter
+{
+    static constexpr int IndexBits = 12;
+    static constexpr int64_t RegisterCount = int64_t(1) << IndexBits;
+    std::vector<uint8_t> registers = std::vector<uint8_t>(RegisterCount);
+
+public:
+    void add(uint64_t hash)
+    {
+        // low bits select the register, the rest provides the run of zeroes (capped at 64 - IndexBits)
+        const auto index = hash & (RegisterCount - 1);
+        const auto rank = countTrailingZeros((hash >> IndexBits) | (uint64_t(1) << (64 - IndexBits))) + 1;
+        registers[index] = std::max<uint8_t>(registers[index], rank);
+    }
+
+    int64_t estimate() const
+    {
+        double sum = 0;
+        int64_t emptyRegisters = 0;
+        for(auto rank : registers)
+        {
+            sum += std::ldexp(1.0, -rank);
+            emptyRegisters += rank == 0;
+        }
+
+        const double m = RegisterCount;
+        const double alpha = 0.7213 / (1 + 1.079 / m);
+        auto estimate = alpha * m * m / sum;
+        if(estimate <= 2.5 * m && emptyRegisters) // small cardinalities: linear counting is more precise
+            estimate = m * std::log(m / emptyRegisters);
+        return std::llround(estimate);
+    }
+};
+
+// Open-addressing (linear probing) hash table assigning consecutive ids to distinct keys.
+template<typename Key>
+class GroupIdTable
+{
+    struct Slot
+    {
+        uint64_t hash;
+        int64_t groupId; // -1 for empty slot
+    };
+
+    std::vector<Slot> slots;
+    uint64_t mask = 0;
+    std::vector<Key> keys; // [group id] => key
+
+    void rehash(size_t capacity)
+    {
+        auto oldSlots = std::move(slots);
+        slots.assign(capacity, Slot{0, -1});
+        mask = capacity - 1;
+        for(auto &slot : oldSlots)
+        {
+            if(slot.groupId < 0)
+                continue;
+
+            auto index = slot.hash & mask;
+            while(slots[index].groupId >= 0)
+                index = (index + 1) & mask;
+            slots[index] = slot;
+        }
+    }
+
+public:
+    explicit GroupIdTable(size_t initialCapacity = 1024)
+    {
+        size_t capacity = 16;
+        while(capacity < initialCapacity)
+            capacity *= 2;
+        rehash(capacity);
+    }
+
+    int64_t groupCount() const { return keys.size(); }
+
+    // Returns id of the key's group. Keys not seen before get the next id, starting from 0.
+    int64_t findOrInsert(const Key &key, uint64_t hash)
+    {
+        for(auto index = hash & mask; ; index = (index + 1) & mask)
+        {
+            auto &slot = slots[index];
+            if(slot.groupId < 0)
+            {
+                // keep load factor at most 1/2
+                if(2 * (keys.size() + 1) > slots.size())
+                {
+                    rehash(2 * slots.size());
+                    return findOrInsert(key, hash);
+                }
+
+                slot = Slot{hash, (int64_t)keys.size()};
+                keys.push_back(key);
+                return slot.groupId;
+            }
+            if(slot.hash == hash && keys[slot.groupId] == key)
+                return slot.groupId;
+        }
+    }
+};
+
+// Rows of a key column split into groups of equal keys.
+struct RowGroups
+{
+    bool hasNulls = false; // if set, group 0 consists of rows with null keys
+    int64_t groupCount = 0;
+    std::vector<int64_t> groupIds; // [row] => group id
+    std::vector<int64_t> firstRows; // [group id] => first row belonging to group
+
+    std::vector<int64_t> groupSizes() const
+    {
+        std::vector<int64_t> sizes(groupCount);
+        for(auto groupId : groupIds)
+            ++sizes[groupId];
+        return sizes;
+    }
+};
+
+// Restricts groups to rows selected by the bitmask (one bit per row). Unselected rows get
+// group id -1, groups left without rows are dropped and the rest is renumbered, so groups
+// come in the same order as if only the selected rows were grouped.
+inline RowGroups selectRows(const RowGroups &groups, const uint8_t *rowMask)
+{
+    const int64_t N = groups.groupIds.size();
+    RowGroups ret;
+    ret.groupIds.resize(N);
+
+    std::vector<int64_t> newIds(groups.groupCount, -1);
+    if(groups.hasNulls)
+    {
+        for(int64_t row = 0; row < N && !ret.hasNulls; row++)
+        {
+            if(groups.groupIds[row] == 0 && arrow::BitUtil::GetBit(rowMask, row))
+            {
+                ret.hasNulls = true;
+                newIds[0] = 0;
+                ret.firstRows.push_back(row);
+            }
+        }
+    }
+
+    for(int64_t row = 0; row < N; row++)
+    {
+        if(!arrow::BitUtil::GetBit(rowMask, row))
+        {
+            ret.groupIds[row] = -1;
+            continue;
+        }
+
+        auto &newId = newIds[groups.groupIds[row]];
+        if(newId < 0)
+        {
+            newId = ret.firstRows.size();
+            ret.firstRows.push_back(row);
+        }
+        ret.groupIds[row] = newId;
+    }
+
+    ret.groupCount = ret.firstRows.size();
+    return ret;
+}
+
+namespace detail
+{
+    // inputs smaller than this are never partitioned
+    constexpr int64_t MinRowsToPartition = 1 << 18;
+    // single table is abandoned (in favor of partitioning) once it holds this many groups
+    constexpr int64_t MaxUnpartitionedGroups = 1 << 16;
+    // target number of rows in a single partition
+    constexpr int64_t RowsPerPartition = 1 << 15;
+    constexpr int MaxPartitionBits = 10;
+
+    // Groups all non-null rows with a single table. Returns false (leaving the result incomplete)
+    // if it turns out that the table would grow too large to stay in cache.
+    template<typename Key>
+    bool groupRowsUnpartitioned(const std::vector<Key> &keys, const std::vector<uint64_t> &hashes, const std::vector<uint8_t> &valid, int64_t firstGroupId, bool canGiveUp, RowGroups &ret)
+    {
+        const int64_t N = keys.size();
+        GroupIdTable<Key> table;
+        for(int64_t row = 0; row < N; row++)
+        {
+            if(!valid[row])
+                continue;
+
+            const auto groupId = firstGroupId + table.findOrInsert(keys[row], hashes[row]);
+            ret.groupIds[row] = groupId;
+            if(groupId == (int64_t)ret.firstRows.size())
+            {
+                ret.firstRows.push_back(row);
+                if(canGiveUp && table.groupCount() > MaxUnpartitionedGroups)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename Key>
+    void groupRowsPartitioned(const std::vector<Key> &keys, const std::vector<uint64_t> &hashes, const std::vector<uint8_t> &valid, int64_t firstGroupId, RowGroups &ret)
+    {
+        const int64_t N = keys.size();
+        int partitionBits = 1;
+        while(partitionBits < MaxPartitionBits && (N >> partitionBits) > RowsPerPartition)
+            ++partitionBits;
+        const int64_t partitionCount = int64_t(1) << partitionBits;
+
+        // Partitions are selected by the top bits of the hash, tables use the low ones.
+        const auto partitionOf = [&] (int64_t row) { return hashes[row] >> (64 - partitionBits); };
+
+        // radix partition rows: histogram, prefix sum, stable scatter
+        std::vector<int64_t> partitionStarts(partitionCount + 1);
+        for(int64_t row = 0; row < N; row++)
+            if(valid[row])
+                ++partitionStarts[partitionOf(row) + 1];
+        for(int64_t i = 0; i < partitionCount; i++)
+            partitionStarts[i + 1] += partitionStarts[i];
+
+        std::vector<int64_t> partitionedRows(partitionStarts.back());
+        {
+            auto cursors = partitionStarts;
+            for(int64_t row = 0; row < N; row++)
+                if(valid[row])
+                    partitionedRows[cursors[partitionOf(row)]++] = row;
+        }
+
+        // group each partition separately, ids are local to partition at first
+        std::vector<std::vector<int64_t>> partitionFirstRows(partitionCount);
+        parallelFor(partitionCount, [&] (int64_t partition)
+        {
+            const auto partitionSize = partitionStarts[partition + 1] - partitionStarts[partition];
+            GroupIdTable<Key> table{size_t(2 * std::min<int64_t>(partitionSize, RowsPerPartition))};
+            auto &firstRows = partitionFirstRows[partition];
+            for(auto i = partitionStarts[partition]; i < partitionStarts[partition + 1]; i++)
+            {
+                const auto row = partitionedRows[i];
+                const auto groupId = table.findOrInsert(keys[row], hashes[row]);
+                ret.groupIds[row] = groupId;
+                if(groupId == (int64_t)firstRows.size())
+                    firstRows.push_back(row);
+            }
+        });
+
+        // make ids global: partitions' groups are laid out one after another
+        std::vector<int64_t> partitionFirstGroup(partitionCount);
+        int64_t nextGroupId = firstGroupId;
+        for(int64_t partition = 0; partition < partitionCount; partition++)
+        {
+            partitionFirstGroup[partition] = nextGroupId;
+            nextGroupId += partitionFirstRows[partition].size();
+            ret.firstRows.insert(ret.firstRows.end(), partitionFirstRows[partition].begin(), partitionFirstRows[partition].end());
+        }
+        parallelFor(partitionCount, [&] (int64_t partition)
+        {
+            for(auto i = partitionStarts[partition]; i < partitionStarts[partition + 1]; i++)
+                ret.groupIds[partitionedRows[i]] += partitionFirstGroup[partition];
+        });
+    }
+}
+
+// Assigns dense group ids to rows, so rows with equal keys share the id.
+// keys[row] is relevant only for rows where valid[row] is set, others form the null group (id 0).
+// Order of groups is unspecified, rows keep their order within group.
+template<typename Key>
+RowGroups groupRows(const std::vector<Key> &keys, const std::vector<uint8_t> &valid)
+{
+    const int64_t N = keys.size();
+    RowGroups ret;
+    ret.groupIds.resize(N);
+
+    for(int64_t row = 0; row < N; row++)
+    {
+        if(!valid[row])
+        {
+            ret.hasNulls = true;
+            ret.firstRows.push_back(row);
+            break;
+        }
+    }
+
+    std::vector<uint64_t> hashes(N);
+    parallelForRanges(N, parallelRangeCount(N, 1 << 16), [&] (int64_t, int64_t begin, int64_t end)
+    {
+        for(auto row = begin; row < end; row++)
+            hashes[row] = valid[row] ? hashKey(keys[row]) : 0;
+    });
+
+    const int64_t firstGroupId = ret.hasNulls;
+    const bool canPartition = N >= detail::MinRowsToPartition;
+    if(!detail::groupRowsUnpartitioned(keys, hashes, valid, firstGroupId, canPartition, ret))
+    {
+        ret.firstRows.resize(firstGroupId);
+        detail::groupRowsPartitioned(keys, hashes, valid, firstGroupId, ret);
+    }
+
+    // null rows were skipped above and still need their id
+    if(ret.hasNulls)
+        for(int64_t row = 0; row < N; row++)
+            if(!valid[row])
+                ret.groupIds[row] = 0;
+
+    ret.groupCount = ret.firstRows.size();
+    return ret;
+}
+
+// Reads values of the key column as group keys, see groupRows.
+template<arrow::Type::type id>
+auto readGroupKeys(const arrow::Column &column)
+{
+    using KeyT = std::conditional_t<id == arrow::Type::STRING, std::string_view, uint64_t>;
+    std::vector<KeyT> keys;
+    std::vector<uint8_t> valid;
+    keys.reserve(column.length());
+    valid.reserve(column.length());
+
+    iterateOver<id>(column,
+        [&] (auto &&value)
+        {
+            if constexpr(id == arrow::Type::STRING)
+                keys.push_back(value);
+            else if constexpr(id == arrow::Type::DOUBLE)
+                keys.push_back(normalizedKeyBits(value));
+            else
+                keys.push_back(static_cast<uint64_t>(toStorage(value)));
+            valid.push_back(1);
+        },
+        [&] ()
+        {
+            keys.push_back(KeyT{});
+            valid.push_back(0);
+        });
+    return std::make_pair(std::move(keys), std::move(valid));
+}
+
+// Groups rows of the key column by their values.
+inline RowGroups groupRows(const arrow::Column &keyColumn)
+{
+    return visitType(*keyColumn.type(), [&] (auto id)
+    {
+        const auto [keys, valid] = readGroupKeys<id.value>(keyColumn);
+        return groupRows(keys, valid);
+    });
+}
+
+// Groups rows of keys in which equal values are known to be adjacent (e.g. sorted ones), with nulls
+// gathered on one side. Each run of equal keys is a group, so no hashing is needed. Ids are assigned
+// like in groupRows: null group is 0 and other groups go in the order of their rows.
+template<typename Key>
+RowGroups groupRuns(const std::vector<Key> &keys, const std::vector<uint8_t> &valid)
+{
+    const int64_t N = keys.size();
+    RowGroups ret;
+    ret.groupIds.resize(N);
+
+    for(int64_t row = 0; row < N; row++)
+    {
+        if(!valid[row])
+        {
+            ret.hasNulls = true;
+            ret.firstRows.push_back(row);
+            break;
+        }
+    }
+
+    for(int64_t row = 0; row < N; row++)
+    {
+        if(!valid[row])
+        {
+            ret.groupIds[row] = 0;
+            continue;
+        }
+
+        if(row == 0 || !valid[row - 1] || !(keys[row] == keys[row - 1]))
+            ret.firstRows.push_back(row);
+        ret.groupIds[row] = ret.firstRows.size() - 1;
+    }
+
+    ret.groupCount = ret.firstRows.size();
+    return ret;
+}
+
+inline RowGroups groupRuns(const arrow::Column &keyColumn)
+{
+    return visitType(*keyColumn.type(), [&] (auto id)
+    {
+        const auto [keys, valid] = readGroupKeys<id.value>(keyColumn);
+        return groupRuns(keys, valid);
+    });
+}
+
+// Group key packed from up to 128 bits.
+struct PackedKey128
+{
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const PackedKey128 &rhs) const { return low == rhs.low && high == rhs.high; }
+};
+
+inline uint64_t hashKey(const PackedKey128 &key) { return hashCombine(hashInteger(key.low), key.high); }
+
+namespace detail
+{
+    // Key column values mapped to codes from [0, maxCode], equal values get equal codes.
+    struct KeyCodes
+    {
+        std::vector<uint64_t> codes;
+        uint64_t maxCode = 0;
+
+        int bitWidth() const
+        {
+            int bits = 0;
+            while(bits < 64 && (maxCode >> bits))
+                ++bits;
+            return bits;
+        }
+    };
+
+    template<typename Key>
+    KeyCodes codesFromGroupIds(const std::vector<Key> &keys, const std::vector<uint8_t> &valid)
+    {
+        auto groups = groupRows(keys, valid);
+        KeyCodes ret;
+        ret.codes.assign(groups.groupIds.begin(), groups.groupIds.end());
+        ret.maxCode = std::max<int64_t>(groups.groupCount - 1, 0);
+        return ret;
+    }
+
+    // Fixed-width values become offsets from the column's minimum (with 0 reserved for null), so
+    // columns of small range take just a few bits. Strings (and values spanning the whole 64-bit
+    // range) are replaced by their group ids.
+    template<arrow::Type::type id>
+    KeyCodes encodeKeyColumn(const arrow::Column &column)
+    {
+        const auto [keys, valid] = readGroupKeys<id>(column);
+        if constexpr(id == arrow::Type::STRING)
+        {
+            return codesFromGroupIds(keys, valid);
+        }
+        else
+        {
+            const int64_t N = keys.size();
+            // with flipped sign bit, unsigned order of integers matches the signed one
+            const uint64_t flip = id == arrow::Type::DOUBLE ? 0 : uint64_t(1) << 63;
+            auto minKey = std::numeric_limits<uint64_t>::max();
+            auto maxKey = std::numeric_limits<uint64_t>::min();
+            for(int64_t row = 0; row < N; row++)
+            {
+                if(valid[row])
+                {
+                    minKey = std::min(minKey, keys[row] ^ flip);
+                    maxKey = std::max(maxKey, keys[row] ^ flip);
+                }
+            }
+
+            if(minKey > maxKey) // no valid values at all
+                return KeyCodes{std::vector<uint64_t>(N), 0};
+            if(maxKey - minKey == std::numeric_limits<uint64_t>::max())
+                return codesFromGroupIds(keys, valid);
+
+            KeyCodes ret;
+            ret.codes.resize(N);
+            for(int64_t row = 0; row < N; row++)
+                ret.codes[row] = valid[row] ? (keys[row] ^ flip) - minKey + 1 : 0;
+            ret.maxCode = maxKey - minKey + 1;
+            return ret;
+        }
+    }
+
+    template<typename Key>
+    std::vector<Key> packKeyCodes(const std::vector<KeyCodes> &columns)
+    {
+        const auto N = columns.front().codes.size();
+        std::vector<Key> packed(N);
+        int bitOffset = 0;
+        for(auto &column : columns)
+        {
+            const auto width = column.bitWidth();
+            for(size_t row = 0; row < N; row++)
+            {
+                const auto code = column.codes[row];
+                if constexpr(std::is_same_v<Key, uint64_t>)
+                {
+                    if(width)
+                        packed[row] |= code << bitOffset;
+                }
+                else
+                {
+                    if(width == 0)
+                        continue;
+                    if(bitOffset >= 64)
+                        packed[row].high |= code << (bitOffset - 64);
+                    else
+                    {
+                        packed[row].low |= code << bitOffset;
+                        if(bitOffset + width > 64)
+                            packed[row].high |= code >> (64 - bitOffset);
+                    }
+                }
+            }
+            bitOffset += width;
+        }
+        return packed;
+    }
+
+    // Groups rows by tuples of their key codes.
+    inline RowGroups groupRowsByCodes(std::vector<KeyCodes> pending, int64_t N)
+    {
+        // Codes of as many columns as fit are packed into a single 64- or 128-bit key. If some columns
+        // are left, ids of groups found so far become the codes of a new column, and packing continues.
+        const std::vector<uint8_t> allValid(N, 1);
+        while(true)
+        {
+            size_t columnsToPack = 0;
+            int totalBits = 0;
+            while(columnsToPack < pending.size() && totalBits + pending[columnsToPack].bitWidth() <= 128)
+                totalBits += pending[columnsToPack++].bitWidth();
+
+            const std::vector<detail::KeyCodes> packedColumns(std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.begin() + columnsToPack));
+            pending.erase(pending.begin(), pending.begin() + columnsToPack);
+
+            auto groups = totalBits <= 64
+                ? groupRows(detail::packKeyCodes<uint64_t>(packedColumns), allValid)
+                : groupRows(detail::packKeyCodes<PackedKey128>(packedColumns), allValid);
+
+            if(pending.empty())
+                return groups;
+
+            detail::KeyCodes groupCodes;
+            groupCodes.codes.assign(groups.groupIds.begin(), groups.groupIds.end());
+            groupCodes.maxCode = groups.groupCount - 1;
+            pending.insert(pending.begin(), std::move(groupCodes));
+        }
+    }
+}
+
+// Groups rows by values of several key columns (composite key).
+// Single column is grouped like in groupRows(const arrow::Column &). For more columns null is
+// treated as a regular key value, so there is no dedicated null group.
+inline RowGroups groupRows(const std::vector<std::shared_ptr<arrow::Column>> &keyColumns)
+{
+    if(keyColumns.empty())
+        throw std::runtime_error("at least one key column is needed for grouping");
+    if(keyColumns.size() == 1)
+        return groupRows(*keyColumns.front());
+
+    const auto N = keyColumns.front()->length();
+    for(auto &column : keyColumns)
+        if(column->length() != N)
+            THROW("mismatched row count: key column `{}` has {} rows, expected {}", column->name(), column->length(), N);
+
+    std::vector<detail::KeyCodes> pending(keyColumns.size());
+    parallelFor(keyColumns.size(), [&] (int64_t i)
+    {
+        pending[i] = visitType(*keyColumns[i]->type(), [&] (auto id)
+        {
+            return detail::encodeKeyColumn<id.value>(*keyColumns[i]);
+        });
+    });
+
+    return detail::groupRowsByCodes(std::move(pending), N);
+}
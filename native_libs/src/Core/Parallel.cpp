@@ -0,0 +1,13 @@
+#include "Parallel.h"
+
+int workerCount()
+{
+    static const int count = std::max<int>(1, std::thread::hardware_concurrency());
+    return count;
+}
+
+bool &insideParallelTask()
+{
+    thread_local bool inside = false;
+    return inside;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Common.h"
+
+// Number of threads (including the calling one) that parallel algorithms are allowed to use.
+DFH_EXPORT int workerCount();
+
+// Set while the current thread executes a task of parallelFor.
+// Nested parallel calls run serially, so they don't oversubscribe the machine.
+DFH_EXPORT bool &insideParallelTask();
+
+// Calls f(index) for each index in [0, count), distributing indices among worker threads.
+// Indices are claimed one by one, so tasks of uneven cost (like columns of different types)
+// are balanced. The first exception thrown by a task is rethrown in the calling thread.
+template<typename F>
+void parallelFor(int64_t count, F &&f)
+{
+    const auto threadCount = insideParallelTask() ? 1 : std::min<int64_t>(workerCount(), count);
+    if(threadCount <= 1)
+    {
+        for(int64_t i = 0; i < count; i++)
+            f(i);
+        return;
+    }
+
+    std::atomic<int64_t> nextIndex{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    const auto worker = [&]
+    {
+        insideParallelTask() = true;
+        try
+        {
+            for(int64_t i = nextIndex++; i < count; i = nextIndex++)
+                f(i);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock{errorMutex};
+            if(!error)
+                error = std::current_exception();
+            nextIndex = count; // no point in starting remaining tasks
+        }
+        insideParallelTask() = false;
+    };
+
+    std::vector<std::thread> threads;
+    for(int64_t i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+    worker();
+    for(auto &thread : threads)
+        thread.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+// How many contiguous ranges should [0, length) be split into, so each has at least
+// minimumRangeLength elements and every worker gets something to do.
+inline int64_t parallelRangeCount(int64_t length, int64_t minimumRangeLength)
+{
+    if(insideParallelTask())
+        return 1;
+    const auto maxRanges = std::max<int64_t>(1, length / std::max<int64_t>(1, minimumRangeLength));
+    return std::min<int64_t>(maxRanges, workerCount());
+}
+
+// [begin, end) of the rangeIndex-th out of rangeCount equal parts of [0, length)
+inline std::pair<int64_t, int64_t> rangeBounds(int64_t length, int64_t rangeCount, int64_t rangeIndex)
+{
+    return { length * rangeIndex / rangeCount, length * (rangeIndex + 1) / rangeCount };
+}
+
+// Calls f(rangeIndex, begin, end) for each of rangeCount contiguous parts of [0, length), in parallel.
+template<typename F>
+void parallelForRanges(int64_t length, int64_t rangeCount, F &&f)
+{
+    parallelFor(rangeCount, [&] (int64_t rangeIndex)
+    {
+        const auto [begin, end] = rangeBounds(length, rangeCount, rangeIndex);
+        f(rangeIndex, begin, end);
+    });
+}
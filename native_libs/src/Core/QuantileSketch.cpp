@@ -0,0 +1,118 @@
+#include "QuantileSketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    constexpr double Pi = 3.14159265358979323846;
+}
+
+QuantileSketch::QuantileSketch(double compression)
+    : compression(compression)
+{
+    if(!(compression >= 1))
+        THROW("quantile sketch compression must be at least 1, got {}", compression);
+}
+
+void QuantileSketch::add(double value)
+{
+    min = totalCount ? std::min(min, value) : value;
+    max = totalCount ? std::max(max, value) : value;
+    ++totalCount;
+
+    buffer.push_back(Centroid{ value, 1 });
+    if(buffer.size() >= 4 * compression)
+        compress();
+}
+
+void QuantileSketch::merge(const QuantileSketch &other)
+{
+    if(!other.totalCount)
+        return;
+
+    min = totalCount ? std::min(min, other.min) : other.min;
+    max = totalCount ? std::max(max, other.max) : other.max;
+    totalCount += other.totalCount;
+
+    buffer.insert(buffer.end(), other.centroids.begin(), other.centroids.end());
+    buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+    if(buffer.size() >= 4 * compression)
+        compress();
+}
+
+void QuantileSketch::compress()
+{
+    if(buffer.empty())
+        return;
+
+    // centroids are already sorted, so only the buffer needs sorting
+    const auto byMean = [] (const Centroid &lhs, const Centroid &rhs) { return lhs.mean < rhs.mean; };
+    std::sort(buffer.begin(), buffer.end(), byMean);
+    const auto sortedCount = centroids.size();
+    centroids.insert(centroids.end(), buffer.begin(), buffer.end());
+    buffer.clear();
+    std::inplace_merge(centroids.begin(), centroids.begin() + sortedCount, centroids.end(), byMean);
+
+    // Neighbours are merged while the centroid spans at most one unit of the scale function
+    // k(q) = compression / 2pi * asin(2q - 1), which is steep near the tails.
+    const double totalWeight = totalCount;
+    const auto k = [&] (double weight)
+    {
+        const auto q = std::min(weight / totalWeight, 1.0);
+        return compression / (2 * Pi) * std::asin(2 * q - 1);
+    };
+
+    std::vector<Centroid> merged;
+    auto current = centroids.front();
+    double weightBefore = 0;
+    for(size_t i = 1; i < centroids.size(); ++i)
+    {
+        const auto &next = centroids[i];
+        const auto proposedWeight = current.weight + next.weight;
+        if(k(weightBefore + proposedWeight) - k(weightBefore) <= 1)
+        {
+            current.mean += (next.mean - current.mean) * next.weight / proposedWeight;
+            current.weight = proposedWeight;
+        }
+        else
+        {
+            merged.push_back(current);
+            weightBefore += current.weight;
+            current = next;
+        }
+    }
+    merged.push_back(current);
+    centroids = std::move(merged);
+}
+
+double QuantileSketch::quantile(double q)
+{
+    compress();
+    if(centroids.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+    if(q <= 0)
+        return min;
+    if(q >= 1)
+        return max;
+
+    // Centroid's weight is spread evenly around its mean, so its center is at the middle of its
+    // ranks. Between the extreme centers and min / max values are interpolated as well.
+    const auto index = q * totalCount;
+    const auto &first = centroids.front();
+    if(index < first.weight / 2)
+        return lerp(min, first.mean, index / (first.weight / 2));
+
+    double center = first.weight / 2;
+    for(size_t i = 0; i + 1 < centroids.size(); ++i)
+    {
+        const auto step = (centroids[i].weight + centroids[i + 1].weight) / 2;
+        if(index < center + step)
+            return lerp(centroids[i].mean, centroids[i + 1].mean, (index - center) / step);
+        center += step;
+    }
+
+    const auto &last = centroids.back();
+    return lerp(last.mean, max, std::min(1.0, (index - center) / (last.weight / 2)));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Common.h"
+
+// Approximate quantiles of a stream of values in bounded memory (merging t-digest).
+// Values are summarized by weighted centroids, which are small near the tails, so extreme
+// quantiles stay accurate. There are at most about `compression` centroids, the rank error of
+// the median is in the order of 1 / compression. Sketches of disjoint sets of values can be
+// merged. NaNs should not be added.
+class DFH_EXPORT QuantileSketch
+{
+public:
+    static constexpr double DefaultCompression = 100;
+
+    QuantileSketch() : QuantileSketch(DefaultCompression) {}
+    explicit QuantileSketch(double compression);
+
+    void add(double value);
+    void merge(const QuantileSketch &other);
+
+    // Interpolates between centroids like exact quantiles interpolate between values. NaN if empty.
+    double quantile(double q);
+    int64_t count() const { return totalCount; }
+
+private:
+    struct Centroid
+    {
+        double mean;
+        double weight;
+    };
+
+    double compression;
+    int64_t totalCount = 0;
+    double min = 0;
+    double max = 0;
+    std::vector<Centroid> centroids; // sorted by mean
+    std::vector<Centroid> buffer; // not yet merged into centroids
+
+    void compress();
+};
@@ -0,0 +1,282 @@
+#include "Reduction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include <arrow/array.h>
+#include <arrow/table.h>
+
+#include "ArrowUtilities.h"
+
+namespace
+{
+    constexpr int64_t BlockSize = 64;
+
+    template<typename T>
+    using ArrayFor = std::conditional_t<std::is_same_v<T, double>, arrow::DoubleArray, arrow::Int64Array>;
+
+    // Calls dense(values, count) for blocks where all values are valid and sparse(values, validity)
+    // for blocks that mix values with nulls.
+    template<typename T, typename Dense, typename Sparse>
+    void forEachBlock(const arrow::ChunkedArray &array, Dense &&dense, Sparse &&sparse)
+    {
+        for(auto &chunk : array.chunks())
+        {
+            const auto length = chunk->length();
+            const auto nullCount = chunk->null_count();
+            if(nullCount == length)
+                continue;
+
+            const auto values = static_cast<const ArrayFor<T> &>(*chunk).raw_values();
+            for(int64_t begin = 0; begin < length; begin += BlockSize)
+            {
+                const auto count = std::min(BlockSize, length - begin);
+                const auto allValid = lowBitsMask(count);
+                const auto validity = nullCount ? validityBits(*chunk, begin, count) : allValid;
+                if(validity == allValid)
+                    dense(values + begin, count);
+                else if(validity)
+                    sparse(values + begin, validity);
+            }
+        }
+    }
+
+    template<typename F>
+    void forEachSetBit(uint64_t bits, F &&f)
+    {
+        for( ; bits; bits &= bits - 1)
+            f(countTrailingZeros(bits));
+    }
+
+    // Adds block sums as leaves of a balanced binary tree: like a binary counter, partial sums
+    // of 2^level blocks are kept and merged when another one of the same size is complete.
+    class PairwiseSum
+    {
+        double partials[64];
+        uint64_t blockCount = 0;
+
+    public:
+        void add(double blockSum)
+        {
+            int level = 0;
+            for(auto carry = blockCount++; carry & 1; carry >>= 1, ++level)
+                blockSum += partials[level];
+            partials[level] = blockSum;
+        }
+
+        double total() const
+        {
+            double ret = 0;
+            for(int level = 0; level < 64; ++level)
+                if(blockCount >> level & 1)
+                    ret += partials[level];
+            return ret;
+        }
+    };
+
+    // Loops below keep Lanes independent accumulators, so they have no dependency between
+    // consecutive values and compilers turn them into vector instructions.
+    constexpr int Lanes = 8;
+
+    double sumDense(const double *values, int64_t count)
+    {
+        int64_t i = 0;
+        double acc[Lanes] = {};
+        for( ; i + Lanes <= count; i += Lanes)
+            for(int lane = 0; lane < Lanes; lane++)
+                acc[lane] += values[i + lane];
+
+        double sum = 0;
+        for(auto laneSum : acc)
+            sum += laneSum;
+        for( ; i < count; i++)
+            sum += values[i];
+        return sum;
+    }
+
+    // Sums of deviations from the mean and of their squares.
+    template<typename T>
+    void sumDeviationsDense(const T *values, int64_t count, double mean, double &deviations, double &squares)
+    {
+        int64_t i = 0;
+        double sum[Lanes] = {}, sumOfSquares[Lanes] = {};
+        for( ; i + Lanes <= count; i += Lanes)
+        {
+            for(int lane = 0; lane < Lanes; lane++)
+            {
+                const auto deviation = values[i + lane] - mean;
+                sum[lane] += deviation;
+                sumOfSquares[lane] += deviation * deviation;
+            }
+        }
+
+        deviations = squares = 0;
+        for(int lane = 0; lane < Lanes; lane++)
+        {
+            deviations += sum[lane];
+            squares += sumOfSquares[lane];
+        }
+        for( ; i < count; i++)
+        {
+            const auto deviation = values[i] - mean;
+            deviations += deviation;
+            squares += deviation * deviation;
+        }
+    }
+
+    // Comparisons are written so that NaN never replaces the accumulator (like minpd / maxpd
+    // returning their second operand, so the lane loop can use them), so NaNs are skipped.
+    template<typename T, typename Better>
+    T reduceExtreme(const arrow::ChunkedArray &array, T initial, Better better)
+    {
+        T ret = initial;
+        forEachBlock<T>(array,
+            [&] (const T *values, int64_t count)
+            {
+                int64_t i = 0;
+                T acc[Lanes];
+                std::fill(std::begin(acc), std::end(acc), ret);
+                for( ; i + Lanes <= count; i += Lanes)
+                    for(int lane = 0; lane < Lanes; lane++)
+                        acc[lane] = better(values[i + lane], acc[lane]) ? values[i + lane] : acc[lane];
+                for( ; i < count; i++)
+                    acc[0] = better(values[i], acc[0]) ? values[i] : acc[0];
+                for(auto value : acc)
+                    ret = better(value, ret) ? value : ret;
+            },
+            [&] (const T *values, uint64_t validity)
+            {
+                forEachSetBit(validity, [&] (int i)
+                {
+                    ret = better(values[i], ret) ? values[i] : ret;
+                });
+            });
+        return ret;
+    }
+
+    // Deviations from an approximate mean sum to its rounding error (times count), subtracting
+    // it corrects both the mean and the squares.
+    MeanAndVariance fromDeviations(double mean, double deviations, double squares, int64_t count)
+    {
+        MeanAndVariance ret;
+        ret.mean = mean + deviations / count;
+        ret.variance = std::max(0.0, (squares - deviations * deviations / count) / count);
+        return ret;
+    }
+}
+
+template<typename T>
+SumAndCount<T> reduceSum(const arrow::ChunkedArray &array)
+{
+    SumAndCount<T> ret;
+    if constexpr(std::is_same_v<T, double>)
+    {
+        PairwiseSum sum;
+        forEachBlock<T>(array,
+            [&] (const double *values, int64_t count)
+            {
+                sum.add(sumDense(values, count));
+                ret.count += count;
+            },
+            [&] (const double *values, uint64_t validity)
+            {
+                double blockSum = 0;
+                forEachSetBit(validity, [&] (int i) { blockSum += values[i]; });
+                sum.add(blockSum);
+                ret.count += popCount(validity);
+            });
+        ret.sum = sum.total();
+    }
+    else
+    {
+        // unsigned, so overflow wraps around instead of being undefined
+        uint64_t sum = 0;
+        forEachBlock<T>(array,
+            [&] (const T *values, int64_t count)
+            {
+                for(int64_t i = 0; i < count; i++)
+                    sum += values[i];
+                ret.count += count;
+            },
+            [&] (const T *values, uint64_t validity)
+            {
+                forEachSetBit(validity, [&] (int i) { sum += values[i]; });
+                ret.count += popCount(validity);
+            });
+        ret.sum = static_cast<T>(sum);
+    }
+    return ret;
+}
+
+template<typename T>
+T reduceMin(const arrow::ChunkedArray &array)
+{
+    return reduceExtreme<T>(array, std::numeric_limits<T>::max(), [] (T value, T acc) { return value < acc; });
+}
+
+template<typename T>
+T reduceMax(const arrow::ChunkedArray &array)
+{
+    return reduceExtreme<T>(array, std::numeric_limits<T>::lowest(), [] (T value, T acc) { return value > acc; });
+}
+
+template<typename T>
+double reduceVariance(const arrow::ChunkedArray &array)
+{
+    const auto sumAndCount = reduceSum<T>(array);
+    const auto n = sumAndCount.count;
+    if(n == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    const auto mean = static_cast<double>(sumAndCount.sum) / n;
+    PairwiseSum deviations, squares;
+    forEachBlock<T>(array,
+        [&] (const T *values, int64_t count)
+        {
+            double blockDeviations, blockSquares;
+            sumDeviationsDense(values, count, mean, blockDeviations, blockSquares);
+            deviations.add(blockDeviations);
+            squares.add(blockSquares);
+        },
+        [&] (const T *values, uint64_t validity)
+        {
+            double blockDeviations = 0, blockSquares = 0;
+            forEachSetBit(validity, [&] (int i)
+            {
+                const auto deviation = values[i] - mean;
+                blockDeviations += deviation;
+                blockSquares += deviation * deviation;
+            });
+            deviations.add(blockDeviations);
+            squares.add(blockSquares);
+        });
+
+    return fromDeviations(mean, deviations.total(), squares.total(), n).variance;
+}
+
+MeanAndVariance meanAndVarianceAround(const double *values, int64_t count, double mean)
+{
+    if(count == 0)
+        return {};
+
+    PairwiseSum deviations, squares;
+    for(int64_t begin = 0; begin < count; begin += BlockSize)
+    {
+        double blockDeviations, blockSquares;
+        sumDeviationsDense(values + begin, std::min(BlockSize, count - begin), mean, blockDeviations, blockSquares);
+        deviations.add(blockDeviations);
+        squares.add(blockSquares);
+    }
+    return fromDeviations(mean, deviations.total(), squares.total(), count);
+}
+
+template SumAndCount<int64_t> reduceSum<int64_t>(const arrow::ChunkedArray &array);
+template SumAndCount<double> reduceSum<double>(const arrow::ChunkedArray &array);
+template int64_t reduceMin<int64_t>(const arrow::ChunkedArray &array);
+template double reduceMin<double>(const arrow::ChunkedArray &array);
+template int64_t reduceMax<int64_t>(const arrow::ChunkedArray &array);
+template double reduceMax<double>(const arrow::ChunkedArray &array);
+template double reduceVariance<int64_t>(const arrow::ChunkedArray &array);
+template double reduceVariance<double>(const arrow::ChunkedArray &array);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "Common.h"
+
+namespace arrow
+{
+    class ChunkedArray;
+}
+
+// Reductions over non-null values of int64 or double arrays (T must be the array's value type).
+// Values buffers are read directly and validity bitmaps a word at a time: blocks of 64 valid
+// values take a null-free path (loops over independent lanes, which compilers vectorize),
+// blocks of nulls are skipped and mixed blocks visit just their set bits.
+//
+// Doubles are summed pairwise: each block is summed in several lanes, then block sums are added
+// up like leaves of a balanced binary tree, so the rounding error grows only with the logarithm
+// of the value count. Integers are summed exactly (wrapping around on overflow).
+
+template<typename T>
+struct SumAndCount
+{
+    T sum = 0;
+    int64_t count = 0;
+};
+
+template<typename T> SumAndCount<T> reduceSum(const arrow::ChunkedArray &array);
+
+// NaNs are skipped. The largest (smallest) T value if there are no values.
+template<typename T> T reduceMin(const arrow::ChunkedArray &array);
+template<typename T> T reduceMax(const arrow::ChunkedArray &array);
+
+// Population variance (divided by the value count), computed from deviations from the mean
+// in a second pass. NaN if there are no values.
+template<typename T> double reduceVariance(const arrow::ChunkedArray &array);
+
+struct MeanAndVariance
+{
+    double mean = std::numeric_limits<double>::quiet_NaN();
+    double variance = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Second pass of the two-pass variance over count values, given their mean from the first pass.
+// The mean is corrected too. Population variance, NaNs for no values.
+MeanAndVariance meanAndVarianceAround(const double *values, int64_t count, double mean);
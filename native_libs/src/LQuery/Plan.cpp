@@ -0,0 +1,334 @@
+#include "Plan.h"
+
+#include <algorithm>
+
+#include <arrow/table.h>
+
+#include <rapidjson/document.h>
+
+#include "Core/ArrowUtilities.h"
+#include "Core/Parallel.h"
+#include "IO/JSON.h"
+#include "LQuery/AST.h"
+#include "LQuery/Interpreter.h"
+#include "Processing.h"
+
+using namespace std::literals;
+
+namespace
+{
+    using namespace plan;
+
+    // number of rows in a single batch when streaming row-wise steps
+    constexpr int64_t RowsPerBatch = 1 << 16;
+
+    bool contains(const std::vector<std::string> &names, const std::string &name)
+    {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    }
+
+    void appendNames(std::vector<std::string> &names, const std::vector<std::string> &namesToAdd)
+    {
+        for(auto &name : namesToAdd)
+            if(!contains(names, name))
+                names.push_back(name);
+    }
+
+    void collectColumnNames(const rapidjson::Value &v, std::vector<std::string> &out)
+    {
+        if(v.IsObject())
+        {
+            if(auto itr = v.FindMember("column"); itr != v.MemberEnd() && itr->value.IsString())
+                appendNames(out, { itr->value.GetString() });
+            for(auto &&member : v.GetObject())
+                collectColumnNames(member.value, out);
+        }
+        else if(v.IsArray())
+        {
+            for(auto &&element : v.GetArray())
+                collectColumnNames(element, out);
+        }
+    }
+
+    // names of columns referenced by LQuery expression
+    std::vector<std::string> referencedColumns(const std::string &lqueryJson)
+    {
+        std::vector<std::string> ret;
+        collectColumnNames(parseJSON(lqueryJson.c_str()), ret);
+        return ret;
+    }
+
+    std::vector<std::string> aggregateInputs(const Aggregate &aggregate)
+    {
+        auto ret = aggregate.keys;
+        for(auto &[column, functions] : aggregate.aggregations)
+            appendNames(ret, { column });
+        return ret;
+    }
+
+    std::vector<std::string> aggregateOutputs(const Aggregate &aggregate)
+    {
+        // naming matches abominableGroupAggregate
+        auto ret = aggregate.keys;
+        for(auto &[column, functions] : aggregate.aggregations)
+            for(auto function : functions)
+                ret.push_back(column + "_"s + to_string(function));
+        return ret;
+    }
+
+    // Columns that step reads from its input.
+    std::vector<std::string> stepInputs(const Step &step)
+    {
+        return visit(overloaded{
+            [] (const Filter &filter) { return referencedColumns(filter.predicateJson); },
+            [] (const DropNA &dropNA) { return dropNA.columns; },
+            [] (const Select &select) { return select.columns; },
+            [] (const Sort &sort) { return transformToVector(sort.keys, [] (auto &&key) { return key.column; }); },
+            [] (const Aggregate &aggregate) { return aggregateInputs(aggregate); },
+            [] (const FilteredAggregate &fused)
+            {
+                auto ret = referencedColumns(fused.filter.predicateJson);
+                appendNames(ret, aggregateInputs(fused.aggregate));
+                return ret;
+            }
+        }, step);
+    }
+
+    // Columns that step outputs, given the columns of its input.
+    std::vector<std::string> stepOutputs(const Step &step, const std::vector<std::string> &inputColumns)
+    {
+        return visit(overloaded{
+            [&] (const Select &select) { return select.columns; },
+            [&] (const Aggregate &aggregate) { return aggregateOutputs(aggregate); },
+            [&] (const FilteredAggregate &fused) { return aggregateOutputs(fused.aggregate); },
+            [&] (const auto &) { return inputColumns; }
+        }, step);
+    }
+
+    bool isRowWise(const Step &step)
+    {
+        return holds_alternative<Filter>(step) || holds_alternative<DropNA>(step) || holds_alternative<Select>(step);
+    }
+
+    std::vector<std::shared_ptr<arrow::Column>> columnsByNames(const arrow::Table &table, const std::vector<std::string> &names)
+    {
+        return transformToVector(names, [&] (auto &&name) { return getColumn(table, name); });
+    }
+
+    std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> aggregationsByNames(const arrow::Table &table, const Aggregate &aggregate)
+    {
+        return transformToVector(aggregate.aggregations, [&] (auto &&aggregation)
+        {
+            return std::make_pair(getColumn(table, aggregation.first), aggregation.second);
+        });
+    }
+
+    std::shared_ptr<arrow::Table> executeStep(const std::shared_ptr<arrow::Table> &table, const Step &step)
+    {
+        return visit(overloaded{
+            [&] (const Filter &filter)
+            {
+                return ::filter(table, filter.predicateJson.c_str());
+            },
+            [&] (const DropNA &dropNA)
+            {
+                if(dropNA.columns.empty())
+                    return ::dropNA(table);
+
+                auto indices = transformToVector(dropNA.columns, [&] (auto &&name)
+                {
+                    return table->schema()->GetFieldIndex(name);
+                });
+                return ::dropNA(table, indices);
+            },
+            [&] (const Select &select)
+            {
+                return tableFromColumns(columnsByNames(*table, select.columns));
+            },
+            [&] (const Sort &sort)
+            {
+                auto sortBy = transformToVector(sort.keys, [&] (auto &&key)
+                {
+                    return SortBy{getColumn(*table, key.column), key.order, key.nulls};
+                });
+                return sortTable(table, sortBy);
+            },
+            [&] (const Aggregate &aggregate)
+            {
+                return abominableGroupAggregate(columnsByNames(*table, aggregate.keys), aggregationsByNames(*table, aggregate));
+            },
+            [&] (const FilteredAggregate &fused)
+            {
+                auto [mapping, predicate] = ast::parsePredicate(*table, fused.filter.predicateJson.c_str());
+                const auto mask = ::execute(*table, predicate, mapping);
+                const auto &aggregate = fused.aggregate;
+                return abominableGroupAggregate(columnsByNames(*table, aggregate.keys), aggregationsByNames(*table, aggregate), mask.get());
+            }
+        }, step);
+    }
+
+    std::shared_ptr<arrow::Table> concatenateBatches(const std::vector<std::shared_ptr<arrow::Table>> &batches)
+    {
+        const auto schema = batches.front()->schema();
+        std::vector<std::shared_ptr<arrow::Column>> columns;
+        for(int i = 0; i < schema->num_fields(); i++)
+        {
+            arrow::ArrayVector chunks;
+            for(auto &batch : batches)
+                for(auto &chunk : batch->column(i)->data()->chunks())
+                    if(chunk->length())
+                        chunks.push_back(chunk);
+
+            // every batch turned out empty
+            if(chunks.empty())
+                return batches.front();
+
+            columns.push_back(std::make_shared<arrow::Column>(schema->field(i), chunks));
+        }
+        return arrow::Table::Make(schema, columns);
+    }
+
+    // Runs row-wise steps over batches of rows, output batches become chunks of the result.
+    std::shared_ptr<arrow::Table> streamRowWiseSteps(const std::shared_ptr<arrow::Table> &table, const std::vector<Step> &steps)
+    {
+        const auto runSteps = [&] (std::shared_ptr<arrow::Table> batch)
+        {
+            for(auto &step : steps)
+                batch = executeStep(batch, step);
+            return batch;
+        };
+
+        const auto rowCount = table->num_rows();
+        const auto batchCount = (rowCount + RowsPerBatch - 1) / RowsPerBatch;
+        if(batchCount <= 1)
+            return runSteps(table);
+
+        std::vector<std::shared_ptr<arrow::Table>> batches(batchCount);
+        parallelFor(batchCount, [&] (int64_t batchIndex)
+        {
+            const auto batchStart = batchIndex * RowsPerBatch;
+            batches[batchIndex] = runSteps(slice(table, batchStart, std::min(RowsPerBatch, rowCount - batchStart)));
+        });
+        return concatenateBatches(batches);
+    }
+}
+
+namespace plan
+{
+    QueryPlan::QueryPlan(std::shared_ptr<arrow::Table> source)
+        : source(std::move(source))
+    {}
+
+    QueryPlan QueryPlan::then(Step step) const
+    {
+        auto ret = *this;
+        ret.steps.push_back(std::move(step));
+        return ret;
+    }
+
+    std::vector<std::string> outputColumns(const QueryPlan &plan)
+    {
+        auto columns = transformToVector(getColumns(*plan.source), [] (auto &&column) { return column->name(); });
+        for(auto &step : plan.steps)
+        {
+            for(auto &name : stepInputs(step))
+                if(!contains(columns, name))
+                    THROW("query plan refers to column `{}` that is not available at that point", name);
+
+            columns = stepOutputs(step, columns);
+        }
+        return columns;
+    }
+
+    QueryPlan optimize(QueryPlan plan)
+    {
+        auto &steps = plan.steps;
+        const auto resultColumns = outputColumns(plan);
+
+        // dropNA on all columns gets explicit list of them, so it won't depend on pruning
+        {
+            auto columns = transformToVector(getColumns(*plan.source), [] (auto &&column) { return column->name(); });
+            for(auto &step : steps)
+            {
+                if(auto dropNA = get_if<DropNA>(&step); dropNA && dropNA->columns.empty())
+                    dropNA->columns = columns;
+                columns = stepOutputs(step, columns);
+            }
+        }
+
+        // Filtering commutes with (stable) sorting, so it's better to sort only rows that will remain.
+        for(bool moved = true; moved; )
+        {
+            moved = false;
+            for(size_t i = 1; i < steps.size(); i++)
+            {
+                const bool isFilter = holds_alternative<Filter>(steps[i]) || holds_alternative<DropNA>(steps[i]);
+                if(isFilter && holds_alternative<Sort>(steps[i - 1]))
+                {
+                    std::swap(steps[i - 1], steps[i]);
+                    moved = true;
+                }
+            }
+        }
+
+        // filter directly followed by aggregate
+        for(size_t i = 0; i + 1 < steps.size(); i++)
+        {
+            auto filter = get_if<Filter>(&steps[i]);
+            auto aggregate = get_if<Aggregate>(&steps[i + 1]);
+            if(filter && aggregate)
+            {
+                steps[i] = FilteredAggregate{ *filter, *aggregate };
+                steps.erase(steps.begin() + i + 1);
+            }
+        }
+
+        // Going backwards, collect columns that are actually needed and drop others at the very start.
+        if(steps.empty() || !holds_alternative<Select>(steps.front()))
+        {
+            auto needed = resultColumns;
+            for(auto itr = steps.rbegin(); itr != steps.rend(); ++itr)
+            {
+                if(holds_alternative<Select>(*itr) || holds_alternative<Aggregate>(*itr) || holds_alternative<FilteredAggregate>(*itr))
+                    needed = stepInputs(*itr);
+                else
+                    appendNames(needed, stepInputs(*itr));
+            }
+
+            std::vector<std::string> sourceColumnsNeeded;
+            for(auto &column : getColumns(*plan.source))
+                if(contains(needed, column->name()))
+                    sourceColumnsNeeded.push_back(column->name());
+
+            if((int)sourceColumnsNeeded.size() < plan.source->num_columns())
+                steps.insert(steps.begin(), Select{ sourceColumnsNeeded });
+        }
+
+        return plan;
+    }
+
+    std::shared_ptr<arrow::Table> execute(const QueryPlan &plan)
+    {
+        const auto optimized = optimize(plan);
+        const auto &steps = optimized.steps;
+
+        auto table = optimized.source;
+        for(size_t i = 0; i < steps.size(); )
+        {
+            auto rowWiseEnd = i;
+            while(rowWiseEnd < steps.size() && isRowWise(steps[rowWiseEnd]))
+                ++rowWiseEnd;
+
+            if(rowWiseEnd > i)
+            {
+                table = streamRowWiseSteps(table, std::vector<Step>(steps.begin() + i, steps.begin() + rowWiseEnd));
+                i = rowWiseEnd;
+            }
+            else
+            {
+                table = executeStep(table, steps[i++]);
+            }
+        }
+        return table;
+    }
+}
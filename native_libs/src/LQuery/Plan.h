@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "variant.h"
+#include "Core/Common.h"
+#include "Analysis.h"
+#include "Sort.h"
+
+namespace arrow
+{
+    class Table;
+}
+
+// Lazy query plans: a pipeline of table operations is recorded first, then optimized
+// as a whole and executed at once. Steps refer to columns by name, as intermediate
+// tables don't exist until the plan is executed.
+namespace plan
+{
+    // Keeps rows matching LQuery predicate (the same JSON as taken by `filter`).
+    struct Filter
+    {
+        std::string predicateJson;
+    };
+
+    // Drops rows with nulls in any of given columns (empty list means all columns).
+    struct DropNA
+    {
+        std::vector<std::string> columns;
+    };
+
+    // Keeps only given columns, in the given order.
+    struct Select
+    {
+        std::vector<std::string> columns;
+    };
+
+    struct SortKey
+    {
+        std::string column;
+        SortOrder order = SortOrder::Ascending;
+        NullPosition nulls = NullPosition::Before;
+    };
+
+    struct Sort
+    {
+        std::vector<SortKey> keys;
+    };
+
+    struct Aggregate
+    {
+        std::vector<std::string> keys;
+        std::vector<std::pair<std::string, std::vector<AggregateFunction>>> aggregations;
+    };
+
+    // Filter directly followed by aggregation, introduced by the optimizer:
+    // aggregates the rows selected by predicate without materializing them.
+    struct FilteredAggregate
+    {
+        Filter filter;
+        Aggregate aggregate;
+    };
+
+    using Step = variant<Filter, DropNA, Select, Sort, Aggregate, FilteredAggregate>;
+
+    struct DFH_EXPORT QueryPlan
+    {
+        std::shared_ptr<arrow::Table> source;
+        std::vector<Step> steps;
+
+        explicit QueryPlan(std::shared_ptr<arrow::Table> source);
+
+        // returns plan with one more step at the end
+        QueryPlan then(Step step) const;
+    };
+
+    // Names of columns produced by the plan. Throws if some step refers to a missing column.
+    DFH_EXPORT std::vector<std::string> outputColumns(const QueryPlan &plan);
+
+    // Rewrites plan into an equivalent, cheaper one:
+    // * filters (and dropNA) are moved before sorts, so fewer rows get sorted;
+    // * columns not needed by later steps nor by the result are dropped right after the source;
+    // * filter followed by aggregation becomes a single FilteredAggregate step.
+    DFH_EXPORT QueryPlan optimize(QueryPlan plan);
+
+    // Optimizes and runs the plan. Leading steps that work row by row (filter, dropNA, select)
+    // are streamed over batches of rows (processed in parallel), sorts and aggregations
+    // consume all batches at once.
+    DFH_EXPORT std::shared_ptr<arrow::Table> execute(const QueryPlan &plan);
+}
@@ -1,8 +1,11 @@
 #include "Processing.h"
 
+#include <algorithm>
 #include <bitset>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <vector>
 
@@ -17,10 +20,14 @@
 #include <boost/preprocessor/repetition/repeat_from_to.hpp>
 
 #include "Core/ArrowUtilities.h"
+#include "Core/Grouping.h"
+#include "Core/Parallel.h"
+#include "IO/JSON.h"
 #include "LQuery/AST.h"
 #include "LQuery/Interpreter.h"
 #include "Analysis.h"
 #include "Sort.h"
+#include "Statistics.h"
 
 using namespace std::literals;
 
@@ -264,59 +271,67 @@ struct FilteredArrayBuilder
         FilteredArrayBuilder fab{mask, length, *column.data()};
         fab.addInternal(column);
         auto retArr = fab.finish();
-        return std::make_shared<arrow::Column>(column.field(), retArr);
+        return std::make_shared<arrow::Column>(subsetField(column, length), retArr);
     }
 };
 
+// Writes interpolated values of a column to a single output buffer, chunk by chunk.
+// Runs of valid values are copied with memcpy, null gaps (possibly spanning several
+// chunks) are filled with a linear ramp once the value closing the gap is known.
 template<arrow::Type::type id>
-struct InterpolatedColumnBuilder
+struct ColumnInterpolator
 {
     using T = typename TypeDescription<id>::StorageValueType;
+    using Array = typename TypeDescription<id>::Array;
     static_assert(std::is_arithmetic_v<T>);
 
-    FixedSizeArrayBuilder<id, false> builder;
-
+    T *output;
     bool hadGoodValue = false;
     T lastGoodValue{};
-    int64_t nanCount = 0;
+    int64_t gapStart = -1; // first row of the null gap waiting for its closing value
 
-    InterpolatedColumnBuilder(std::shared_ptr<arrow::DataType> type, int64_t length)
-        : builder(std::move(type), length)
-    {}
+    explicit ColumnInterpolator(T *output) : output(output) {}
 
-    template<typename U>
-    void operator()(U validValueObserved)
+    void closeGap(int64_t gapEnd, T nextValue)
     {
-        auto validValue = toStorage(validValueObserved);
-        if(nanCount)
+        const auto gapLength = gapEnd - gapStart;
+        if(!hadGoodValue)
+        {
+            std::fill(output + gapStart, output + gapEnd, nextValue);
+        }
+        else
         {
-            if(!hadGoodValue)
+            const double parts = gapLength + 1;
+            for(int64_t i = 1; i <= gapLength; i++)
+                output[gapStart + i - 1] = lerp(lastGoodValue, nextValue, i / parts);
+        }
+        gapStart = -1;
+    }
+
+    void addChunk(const arrow::Array &chunk, int64_t chunkStart)
+    {
+        const auto values = static_cast<const Array &>(chunk).raw_values();
+        forEachValidityRun(chunk, [&] (int64_t begin, int64_t end, bool valid)
+        {
+            if(valid)
             {
-                lastGoodValue = validValue;
+                std::memcpy(output + chunkStart + begin, values + begin, (end - begin) * sizeof(T));
+                if(gapStart >= 0)
+                    closeGap(chunkStart + begin, values[begin]);
+                lastGoodValue = values[end - 1];
+                hadGoodValue = true;
             }
-
-            const double parts = nanCount + 1;
-            for(int64_t i = 1; i <= nanCount; i++)
+            else if(gapStart < 0)
             {
-                builder.Append(lerp(lastGoodValue, validValue, i / parts));
+                gapStart = chunkStart + begin;
             }
-            nanCount = 0;
-        }
-        builder.Append(validValue);
-        lastGoodValue = validValue;
-        hadGoodValue = true;
-    }
-    void operator()()
-    {
-        ++nanCount;
+        });
     }
 
-    auto finish()
+    void finish(int64_t length)
     {
-        for(int64_t i = 0; i < nanCount; i++)
-            builder.Append(lastGoodValue);
-
-        return builder.Finish();
+        if(gapStart >= 0)
+            std::fill(output + gapStart, output + length, lastGoodValue);
     }
 };
 
@@ -329,7 +344,7 @@ std::shared_ptr<arrow::Buffer> slice(std::shared_ptr<arrow::Buffer> buffer, int6
 std::shared_ptr<arrow::Column> slice(std::shared_ptr<arrow::Column> column, int64_t startAt, int64_t length)
 {
     validateSlice(column->length(), startAt, length);
-    return column->Slice(startAt, length);
+    return std::make_shared<arrow::Column>(subsetField(*column, length), column->data()->Slice(startAt, length));
 }
 
 std::shared_ptr<arrow::Array> slice(std::shared_ptr<arrow::Array> array, int64_t startAt, int64_t length)
@@ -338,6 +353,16 @@ std::shared_ptr<arrow::Array> slice(std::shared_ptr<arrow::Array> array, int64_t
     return array->Slice(startAt, length);
 }
 
+std::shared_ptr<arrow::Table> slice(std::shared_ptr<arrow::Table> table, int64_t startAt, int64_t length)
+{
+    validateSlice(table->num_rows(), startAt, length);
+    auto columns = transformToVector(getColumns(*table), [&] (auto &&column)
+    {
+        return std::make_shared<arrow::Column>(subsetField(*column, length), column->data()->Slice(startAt, length));
+    });
+    return tableWithColumns(*table, columns, length);
+}
+
 std::shared_ptr<arrow::Column> interpolateNA(std::shared_ptr<arrow::Column> column)
 {
     // no missing values -- no itnerpolation needed
@@ -358,38 +383,70 @@ std::shared_ptr<arrow::Column> interpolateNA(std::shared_ptr<arrow::Column> colu
         }
         else
         {
-            InterpolatedColumnBuilder<id.value> builder{ column->type(), column->length() };
-            iterateOver<id.value>(*column, builder, builder);
-            auto arr = builder.finish();
-            return std::make_shared<arrow::Column>(setNullable(false, column->field()), arr);
+            using T = typename TypeDescription<id.value>::StorageValueType;
+            auto [buffer, data] = allocateBuffer<T>(column->length());
+            ColumnInterpolator<id.value> interpolator{data};
+            int64_t chunkStart = 0;
+            for(auto &&chunk : column->data()->chunks())
+            {
+                interpolator.addChunk(*chunk, chunkStart);
+                chunkStart += chunk->length();
+            }
+            interpolator.finish(column->length());
+
+            auto arr = std::make_shared<typename TypeDescription<id.value>::Array>(column->type(), column->length(), buffer, nullptr);
+            return std::make_shared<arrow::Column>(withoutStatistics(setNullable(false, column->field())), arr);
         }
     });
 }
 
 std::shared_ptr<arrow::Table> interpolateNA(std::shared_ptr<arrow::Table> table)
 {
-    auto interpolatedColumns = transformToVector(getColumns(*table), [] (auto col)
-        { return interpolateNA(col); });
+    const auto columns = getColumns(*table);
+    std::vector<std::shared_ptr<arrow::Column>> interpolatedColumns(columns.size());
+    parallelFor(columns.size(), [&] (int64_t i)
+    {
+        interpolatedColumns[i] = interpolateNA(columns[i]);
+    });
     return arrow::Table::Make(setNullable(false, table->schema()), interpolatedColumns);
 }
 
 std::shared_ptr<arrow::Table> dropNA(std::shared_ptr<arrow::Table> table, const std::vector<int> &columnIndices)
 {
-    // Start with "all valid" mask and cross out the nulls
-    BitmaskGenerator bitmask{table->num_rows(), true};
+    const auto rowCount = table->num_rows();
+
+    // Start with "all valid" mask and cross out the nulls.
+    // Mask is processed in 64-bit words: each column contributes its validity bitmap
+    // (stitched across chunks, see forEachValidityWord) that gets ANDed into the mask.
+    const auto wordCount = (rowCount + 63) / 64;
+    auto [maskBuffer, maskWords] = allocateBuffer<uint64_t>(wordCount);
+    std::fill_n(maskWords, wordCount, ~uint64_t(0));
+
+    bool anyNulls = false;
     for(auto columnIndex : columnIndices)
     {
         auto column = table->column(columnIndex);
-        if(column->null_count() == 0)
+        const auto nullCount = column->null_count();
+        if(nullCount == 0) // fully valid column cannot drop anything
             continue;
 
-        int64_t row = 0;
-        iterateOverGeneric(*column,
-            [&] (auto&&) { row++;                },
-            [&] ()       { bitmask.clear(row++); });
+        anyNulls = true;
+        if(nullCount == column->length()) // all rows will be dropped anyway
+        {
+            std::fill_n(maskWords, wordCount, uint64_t(0));
+            break;
+        }
+
+        forEachValidityWord(*column->data(), [&, maskWords = maskWords] (int64_t wordIndex, uint64_t validity, int64_t)
+        {
+            maskWords[wordIndex] &= validity;
+        });
     }
 
-    return filter(table, *bitmask.buffer);
+    if(!anyNulls)
+        return table;
+
+    return filter(table, *maskBuffer);
 }
 
 std::shared_ptr<arrow::Table> dropNA(std::shared_ptr<arrow::Table> table)
@@ -401,9 +458,25 @@ std::shared_ptr<arrow::Table> dropNA(std::shared_ptr<arrow::Table> table)
     return dropNA(table, columnIndices);
 }
 
+// Value buffer can be patched in place only when nobody else may observe it: the array is owned
+// just by the caller and the buffer is referenced only by the array's data.
+bool ownsValueBufferExclusively(const std::shared_ptr<arrow::Array> &array)
+{
+    if(array.use_count() != 1)
+        return false;
+
+    const auto data = array->data();
+    if(data.use_count() != 2) // the array itself and our local copy
+        return false;
+
+    const auto &buffer = data->buffers.at(1);
+    return buffer && buffer.use_count() == 1 && buffer->is_mutable();
+}
+
 template<typename Array>
-std::shared_ptr<arrow::Array> fillNATyped(const Array &array, DynamicField value)
+std::shared_ptr<arrow::Array> fillNATyped(const std::shared_ptr<arrow::Array> &arrayPtr, const Array &array, DynamicField value)
 {
+    const auto length = array.length();
     if constexpr(std::is_same_v<Array, arrow::StringArray>)
     {
         std::string_view valueToFill = visit(overloaded{
@@ -412,25 +485,80 @@ std::shared_ptr<arrow::Array> fillNATyped(const Array &array, DynamicField value
             [] (const auto &v) -> std::string_view { throw std::runtime_error("cannot fill string array with value of type "s + typeid(v).name()); }
             }, value);
 
-        arrow::StringBuilder builder;
-        iterateOver<arrow::Type::STRING>(array,
-            [&] (auto &&s) { builder.Append(s.data(), s.size()); },
-            [&] () { builder.Append(valueToFill.data(), valueToFill.size()); });
-        return finish(builder);
+        const int64_t fillLength = valueToFill.size();
+        const auto sourceOffsets = array.raw_value_offsets();
+        const auto sourceData = array.value_data()->data();
 
+        const int64_t maxTotalLength = sourceOffsets[length] - sourceOffsets[0] + array.null_count() * fillLength;
+        if(maxTotalLength > std::numeric_limits<int32_t>::max())
+            THROW("cannot fill nulls: resulting string array would need {} bytes", maxTotalLength);
+
+        // Offsets: valid runs are the source offsets shifted, null slots advance by the filler length.
+        auto [offsetsBuffer, offsets] = allocateBuffer<int32_t>(length + 1);
+        offsets[0] = 0;
+        forEachValidityRun(array, [&, offsets = offsets] (int64_t begin, int64_t end, bool valid)
+        {
+            if(valid)
+            {
+                const auto shift = offsets[begin] - sourceOffsets[begin];
+                for(auto i = begin + 1; i <= end; i++)
+                    offsets[i] = sourceOffsets[i] + shift;
+            }
+            else
+            {
+                for(auto i = begin + 1; i <= end; i++)
+                    offsets[i] = offsets[i - 1] + (int32_t)fillLength;
+            }
+        });
+
+        // Characters: each valid run is a single contiguous copy.
+        auto [dataBuffer, characters] = allocateBuffer<uint8_t>(offsets[length]);
+        forEachValidityRun(array, [&, offsets = offsets, characters = characters] (int64_t begin, int64_t end, bool valid)
+        {
+            if(valid)
+                std::memcpy(characters + offsets[begin], sourceData + sourceOffsets[begin], sourceOffsets[end] - sourceOffsets[begin]);
+            else
+                for(auto i = begin; i < end; i++)
+                    std::memcpy(characters + offsets[i], valueToFill.data(), fillLength);
+        });
+
+        return std::make_shared<arrow::StringArray>(length, offsetsBuffer, dataBuffer);
     }
     else
     {
         using T = typename Array::value_type;
-        auto valueToFill = get<T>(value);
-        auto [buffer, data] = allocateBuffer<T>(array.length());
-        int row = 0;
-        std::memcpy(data, array.raw_values(), buffer->size());
-        iterateOver<ArrayTypeDescription<Array>::id>(array,
-            [&] (auto &&) { ++row; },
-            [&, data=data] () { data[row++] = valueToFill; });
+        const T valueToFill = visit([&] (const auto &v) -> T
+        {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr(std::is_same_v<V, T>)
+                return v;
+            else if constexpr(std::is_same_v<V, Timestamp> && std::is_same_v<Array, arrow::TimestampArray>)
+                return v.toStorage();
+            else
+                throw std::runtime_error("cannot fill array of type " + array.type()->ToString() + " with value of type "s + typeid(v).name());
+        }, value);
+
+        const auto fillNulls = [&] (T *data)
+        {
+            forEachValidityRun(array, [&] (int64_t begin, int64_t end, bool valid)
+            {
+                if(!valid)
+                    std::fill(data + begin, data + end, valueToFill);
+            });
+        };
 
-        return std::make_shared<Array>(array.type(), array.length(), buffer, nullptr);
+        if(ownsValueBufferExclusively(arrayPtr))
+        {
+            // nobody else sees the values, so they can be patched in place and only the bitmap is dropped
+            const auto buffer = array.data()->buffers[1];
+            fillNulls(reinterpret_cast<T *>(buffer->mutable_data()) + array.offset());
+            return std::make_shared<Array>(array.type(), length, buffer, nullptr, 0, array.offset());
+        }
+
+        auto [buffer, data] = allocateBuffer<T>(length);
+        std::memcpy(data, array.raw_values(), buffer->size());
+        fillNulls(data);
+        return std::make_shared<Array>(array.type(), length, buffer, nullptr);
     }
 }
 
@@ -439,11 +567,11 @@ std::shared_ptr<arrow::Array> fillNA(std::shared_ptr<arrow::Array> array, Dynami
     if(array->null_count() == 0)
         return array;
 
-    return visitArray(*array, [&] (auto *array)
+    return visitArray(*array, [&] (auto *typedArray)
     {
         return visit([&] (auto value)
         {
-            return fillNATyped(*array, value);
+            return fillNATyped(array, *typedArray, value);
         }, value);
     });
 }
@@ -465,7 +593,7 @@ std::shared_ptr<arrow::Column> fillNA(std::shared_ptr<arrow::Column> column, Dyn
     if(column->null_count() == 0)
         return column;
 
-    auto newField = setNullable(false, column->field());
+    auto newField = withoutStatistics(setNullable(false, column->field()));
     auto newChunks = fillNA(column->data(), value);
     return std::make_shared<arrow::Column>(newField, newChunks);
 }
@@ -494,8 +622,153 @@ std::shared_ptr<arrow::Table> fillNA(std::shared_ptr<arrow::Table> table, const
     return arrow::Table::Make(newSchema, newColumns);
 }
 
+// Index of the first row for which isBefore doesn't hold (it must hold for a prefix of rows).
+// Nothing for doubles with NaN: they are not ordered, so the search would not be meaningful.
+template<arrow::Type::type id, typename Predicate>
+std::optional<int64_t> partitionPoint(const arrow::Column &column, Predicate &&isBefore)
+{
+    int64_t chunkStart = 0;
+    for(auto &chunk : column.data()->chunks())
+    {
+        const auto &array = static_cast<const typename TypeDescription<id>::Array &>(*chunk);
+        const auto values = array.raw_values();
+        const auto length = array.length();
+        if constexpr(id == arrow::Type::DOUBLE)
+        {
+            // sorting puts NaNs at an end, so checking the ends of sorted chunks finds them
+            if(length && (std::isnan(values[0]) || std::isnan(values[length - 1])))
+                return std::nullopt;
+        }
+        const int64_t point = std::partition_point(values, values + length, isBefore) - values;
+        if(point < length)
+            return chunkStart + point;
+        chunkStart += length;
+    }
+    return chunkStart;
+}
+
+using RowRange = std::pair<int64_t, int64_t>; // [begin, end)
+
+// Rows of a sorted column without nulls, for which `value op literal` holds.
+template<arrow::Type::type id, typename Literal>
+std::optional<RowRange> sortedColumnRange(const arrow::Column &column, bool ascending, ast::PredicateFromValueOperator op, Literal literal)
+{
+    if constexpr(std::is_floating_point_v<Literal>)
+    {
+        if(std::isnan(literal))
+            return std::nullopt;
+    }
+
+    // rows before the literal's place in the column and rows up to it (inclusive)
+    const auto before = partitionPoint<id>(column, [&] (auto value) { return ascending ? value < literal : value > literal; });
+    const auto upTo = partitionPoint<id>(column, [&] (auto value) { return ascending ? value <= literal : value >= literal; });
+    if(!before || !upTo)
+        return std::nullopt;
+
+    switch(op)
+    {
+    case ast::PredicateFromValueOperator::Lesser:
+        return ascending ? RowRange{0, *before} : RowRange{*upTo, column.length()};
+    case ast::PredicateFromValueOperator::Greater:
+        return ascending ? RowRange{*upTo, column.length()} : RowRange{0, *before};
+    default:
+        return RowRange{*before, *upTo};
+    }
+}
+
+// If the LQuery predicate compares a column known to be sorted with a literal (or is a conjunction
+// of such comparisons), selected rows form a contiguous range that is found by binary search.
+std::optional<RowRange> sortedRangeSelectedBy(const arrow::Table &table, const rapidjson::Value &predicate)
+{
+    if(!predicate.IsObject())
+        return std::nullopt;
+
+    const auto argumentsItr = predicate.FindMember("arguments");
+    if(argumentsItr == predicate.MemberEnd() || !argumentsItr->value.IsArray())
+        return std::nullopt;
+    const auto &arguments = argumentsItr->value;
+
+    if(const auto boolean = predicate.FindMember("boolean"); boolean != predicate.MemberEnd())
+    {
+        if(!boolean->value.IsString() || boolean->value.GetString() != "and"sv || arguments.Empty())
+            return std::nullopt;
+
+        RowRange ret{0, table.num_rows()};
+        for(auto &&argument : arguments.GetArray())
+        {
+            const auto range = sortedRangeSelectedBy(table, argument);
+            if(!range)
+                return std::nullopt;
+            ret.first = std::max(ret.first, range->first);
+            ret.second = std::min(ret.second, range->second);
+        }
+        ret.second = std::max(ret.first, ret.second);
+        return ret;
+    }
+
+    const auto operatorName = predicate.FindMember("predicate");
+    if(operatorName == predicate.MemberEnd() || !operatorName->value.IsString() || arguments.Size() != 2)
+        return std::nullopt;
+
+    using Operator = ast::PredicateFromValueOperator;
+    const std::string_view name = operatorName->value.GetString();
+    auto op = Operator::Equal;
+    if(name == "gt")
+        op = Operator::Greater;
+    else if(name == "lt")
+        op = Operator::Lesser;
+    else if(name != "eq")
+        return std::nullopt;
+
+    // column may be on either side of comparison
+    const auto isColumn = [] (const rapidjson::Value &v) { return v.IsObject() && v.HasMember("column") && v["column"].IsString(); };
+    const rapidjson::SizeType columnArgument = isColumn(arguments[0u]) ? 0 : 1;
+    if(!isColumn(arguments[columnArgument]))
+        return std::nullopt;
+    const auto &literal = arguments[1 - columnArgument];
+    if(columnArgument == 1 && op != Operator::Equal)
+        op = op == Operator::Greater ? Operator::Lesser : Operator::Greater;
+
+    const auto columnIndex = table.schema()->GetFieldIndex(arguments[columnArgument]["column"].GetString());
+    if(columnIndex < 0)
+        return std::nullopt;
+
+    // Comparisons don't look at validity, so nulls would be compared by whatever values they store.
+    const auto column = table.column(columnIndex);
+    const auto statistics = readStatistics(*column);
+    if(!statistics || !statistics->isSorted() || column->null_count() != 0)
+        return std::nullopt;
+
+    // literals are read the same way as by the LQuery parser
+    const auto type = column->type()->id();
+    const auto numericRange = [&] (auto literalValue) -> std::optional<RowRange>
+    {
+        if(type == arrow::Type::INT64)
+            return sortedColumnRange<arrow::Type::INT64>(*column, statistics->ascending, op, literalValue);
+        if(type == arrow::Type::DOUBLE)
+            return sortedColumnRange<arrow::Type::DOUBLE>(*column, statistics->ascending, op, literalValue);
+        return std::nullopt;
+    };
+
+    if(type == arrow::Type::TIMESTAMP)
+    {
+        if(literal.IsObject() && literal.HasMember("timestampNs") && literal["timestampNs"].IsInt64())
+            return sortedColumnRange<arrow::Type::TIMESTAMP>(*column, statistics->ascending, op, literal["timestampNs"].GetInt64());
+    }
+    else if(literal.IsFloat())
+        return numericRange(double(literal.GetFloat()));
+    else if(literal.IsInt64())
+        return numericRange(literal.GetInt64());
+
+    return std::nullopt;
+}
+
 std::shared_ptr<arrow::Table> filter(std::shared_ptr<arrow::Table> table, const char *dslJsonText)
 {
+    // filtering sorted data by its range needs no predicate evaluation
+    if(const auto range = sortedRangeSelectedBy(*table, parseJSON(dslJsonText)))
+        return slice(table, range->first, range->second - range->first);
+
     auto [mapping, predicate] = ast::parsePredicate(*table, dslJsonText);
     const auto maskBuffer = execute(*table, predicate, mapping);
     return filter(table, *maskBuffer);
@@ -506,23 +779,22 @@ std::shared_ptr<arrow::Table> filter(std::shared_ptr<arrow::Table> table, const
     const unsigned char * const maskData = maskBuffer.data();
     const auto oldRowCount = table->num_rows();
 
-    int newRowCount = 0;
-    for(int i = 0; i < oldRowCount; i++)
-        newRowCount += arrow::BitUtil::GetBit(maskData, i);
-
-    std::vector<std::shared_ptr<arrow::Column>> newColumns;
+    int64_t newRowCount = 0;
+    for(int64_t i = 0; i < oldRowCount; i += 64)
+        newRowCount += popCount(loadBits(maskData, i, std::min<int64_t>(64, oldRowCount - i)));
 
-    for(int columnIndex = 0; columnIndex < table->num_columns(); columnIndex++)
+    // Columns are filtered independently of each other, so we do it in parallel.
+    std::vector<std::shared_ptr<arrow::Column>> newColumns(table->num_columns());
+    parallelFor(table->num_columns(), [&] (int64_t columnIndex)
     {
-        const auto column = table->column(columnIndex);
-        const auto filteredColumn = visitType(*column->type(), [&] (auto id) -> std::shared_ptr<arrow::Column>
+        const auto column = table->column((int)columnIndex);
+        newColumns[columnIndex] = visitType(*column->type(), [&] (auto id) -> std::shared_ptr<arrow::Column>
         {
             return FilteredArrayBuilder<id.value>::makeFiltered(maskData, newRowCount, *column);
         });
-        newColumns.push_back(filteredColumn);
-    }
+    });
 
-    return arrow::Table::Make(table->schema(), newColumns);
+    return tableWithColumns(*table, newColumns, newRowCount);
 }
 
 std::shared_ptr<arrow::Array> each(std::shared_ptr<arrow::Table> table, const char *dslJsonText)
@@ -536,9 +808,10 @@ DFH_EXPORT std::shared_ptr<arrow::Column> shift(std::shared_ptr<arrow::Column> c
     if(offset == 0)
         return column;
 
-    const auto id = column->type()->id();
+    // Shifted column consists of a slice of the original data and a nulls chunk, no values are copied.
+    const auto field = withoutStatistics(setNullable(true, column->field()));
     if(std::abs(offset) >= column->length())
-        return std::make_shared<arrow::Column>(column->field(), makeNullsArray(column->type(), column->length()));
+        return std::make_shared<arrow::Column>(field, makeNullsArray(column->type(), column->length()));
 
     auto nullsPart = makeNullsArray(column->type(), std::abs(offset));
     auto remainingLength = column->length() - std::abs(offset);
@@ -555,7 +828,7 @@ DFH_EXPORT std::shared_ptr<arrow::Column> shift(std::shared_ptr<arrow::Column> c
         newChunks = column->Slice(std::abs(offset), remainingLength)->data()->chunks();
         newChunks.push_back(nullsPart);
     }
-    return std::make_shared<arrow::Column>(column->field(), newChunks);
+    return std::make_shared<arrow::Column>(field, newChunks);
 }
 
 // specialize!
@@ -610,85 +883,55 @@ DynamicField adjustTypeForFilling(DynamicField valueGivenByUser, const arrow::Da
 
 DFH_EXPORT std::shared_ptr<arrow::Table> groupBy(std::shared_ptr<arrow::Table> table, std::shared_ptr<arrow::Column> keyColumn)
 {
-    if(keyColumn->length() != table->num_rows())
-        throw std::runtime_error("mismatched row count");
+    return groupBy(table, std::vector<std::shared_ptr<arrow::Column>>{ keyColumn });
+}
 
-    return visitType(*keyColumn->type(), [&](auto keyTypeID)
+DFH_EXPORT std::shared_ptr<arrow::Table> groupBy(std::shared_ptr<arrow::Table> table, const std::vector<std::shared_ptr<arrow::Column>> &keyColumns)
+{
+    for(auto &keyColumn : keyColumns)
+        if(keyColumn->length() != table->num_rows())
+            throw std::runtime_error("mismatched row count");
+
+    // equal keys of a sorted column are adjacent, so each run of them is a group
+    const auto groups = keyColumns.size() == 1 && isKnownSorted(*keyColumns.front())
+        ? groupRuns(*keyColumns.front())
+        : groupRows(keyColumns);
+    const auto groupCount = groups.groupCount;
+
+    // Counting sort of rows by group id. Prefix sum of group sizes gives list offsets,
+    // which are the same for each grouped column, so the buffer is shared across all of them.
+    auto [offsetsBuffer, offsets] = allocateBuffer<int32_t>(groupCount + 1);
+    std::fill(offsets, offsets + groupCount + 1, 0);
+    for(auto groupId : groups.groupIds)
+        ++offsets[groupId + 1];
+    for(int64_t group = 0; group < groupCount; group++)
+        offsets[group + 1] += offsets[group];
+
+    Permutation permutation(table->num_rows());
     {
-        const auto N = table->num_rows();
-
-        using TypeT = typename TypeDescription<keyTypeID.value>::ArrowType;
-        using KeyT = typename TypeDescription<keyTypeID.value>::ObservedType;
-        std::unordered_map<KeyT, std::vector<int64_t>> keyToRows;
-        std::vector<int64_t> nullRows;
-
-        int64_t row = 0;
-        iterateOver<keyTypeID.value>(*keyColumn,
-            [&] (auto &&value)
-            {
-                keyToRows[value].push_back(row++);
-            },
-            [&] ()
-            {
-                nullRows.push_back(row++);
-            });
-
-        Permutation permutation(N);
-        auto target = permutation.begin();
-        target = std::copy(nullRows.begin(), nullRows.end(), target);
-        for(auto &[keyval, rows] : keyToRows)
-            target = std::copy(rows.begin(), rows.end(), target);
-
-        const auto groupCount = keyToRows.size() + !!nullRows.size();
-
-        // be smart: each column for a given group has same group size
-        // so we can create offsets buffer once and reuse it across all grouped columns
-        auto buffer = allocateBuffer<int32_t>(groupCount + 1);
-        *buffer.second++ = 0;
-        int64_t currentOffset = 0;
-        auto prepareForGroupOfSize = [&] (int64_t size)
-        {
-            currentOffset += size;
-            *buffer.second++ = currentOffset;
-        };
-        if(nullRows.size())
-            prepareForGroupOfSize(nullRows.size());
-        for(auto &[key, groupRows] : keyToRows)
-            prepareForGroupOfSize(groupRows.size());
-        // buffer is done
-
-
-        std::vector<std::shared_ptr<arrow::Column>> newColumns;
+        std::vector<int64_t> cursors(offsets, offsets + groupCount);
+        for(int64_t row = 0; row < (int64_t)groups.groupIds.size(); row++)
+            permutation[cursors[groups.groupIds[row]]++] = row;
+    }
 
-        // first prepare key column
-        {
-            auto builder = makeBuilder(std::static_pointer_cast<TypeT>(keyColumn->type()));
-            if(nullRows.size() > 0)
-                builder->AppendNull();
-            for(auto &&[keyValue, rows] : keyToRows)
-                append(*builder, keyValue);
-
-            const auto arr = finish(*builder);
-            newColumns.push_back(std::make_shared<arrow::Column>(keyColumn->field(), arr));
-        }
+    std::vector<std::shared_ptr<arrow::Column>> newColumns;
 
-        for(auto column : getColumns(*table))
-        {
-            if(column == keyColumn)
-                continue;
+    // key columns: value from the first row of each group
+    for(auto &keyColumn : keyColumns)
+        newColumns.push_back(std::make_shared<arrow::Column>(gatheredField(*keyColumn, groups.firstRows), permuteToArray(keyColumn, groups.firstRows)));
 
-            visitType(column->type()->id(), [&](auto colType)
-            {
-                const auto listType = std::make_shared<arrow::ListType>(column->field());
+    for(auto column : getColumns(*table))
+    {
+        if(std::find(keyColumns.begin(), keyColumns.end(), column) != keyColumns.end())
+            continue;
 
-                auto permutedArray = permuteToArray(column, permutation);
-                auto groupedArray = std::make_shared<arrow::ListArray>(listType, groupCount, buffer.first, permutedArray, nullptr, 0);
-                newColumns.push_back(toColumn(groupedArray, column->name()));
-            });
-        }
+        const auto listType = std::make_shared<arrow::ListType>(column->field());
+        auto permutedArray = permuteToArray(column, permutation);
+        auto groupedArray = std::make_shared<arrow::ListArray>(listType, groupCount, offsetsBuffer, permutedArray, nullptr, 0);
+        newColumns.push_back(toColumn(groupedArray, column->name()));
+    }
 
-        return tableFromColumns(newColumns);
-    });
+    return tableFromColumns(newColumns);
 }
 
 std::shared_ptr<arrow::Column> splitOn(const arrow::Column &column, std::string_view separator)
@@ -36,6 +36,7 @@ DFH_EXPORT std::shared_ptr<arrow::Column> shift(std::shared_ptr<arrow::Column> c
 
 DFH_EXPORT DynamicField adjustTypeForFilling(DynamicField valueGivenByUser, const arrow::DataType &type);
 DFH_EXPORT std::shared_ptr<arrow::Table> groupBy(std::shared_ptr<arrow::Table> table, std::shared_ptr<arrow::Column> keyColumn);
+DFH_EXPORT std::shared_ptr<arrow::Table> groupBy(std::shared_ptr<arrow::Table> table, const std::vector<std::shared_ptr<arrow::Column>> &keyColumns);
 
 DFH_EXPORT std::shared_ptr<arrow::Column> splitOn(const arrow::Column &column, std::string_view separator); // Column String -> Column [String]
 DFH_EXPORT std::shared_ptr<arrow::Column> ungroup(const arrow::Column &data, const arrow::Column &listColumn); // (Column t1, Column [t2]) -> Column t1
@@ -1,218 +1,846 @@
 #include "Sort.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <numeric>
+
 #include "Core/ArrowUtilities.h"
+#include "Core/Grouping.h"
+#include "Core/Parallel.h"
+#include "Statistics.h"
 
-template<typename F>
-auto dispatch(SortOrder order, F &&f)
+namespace
 {
-    switch(order)
+
+// below that many rows permuting is not split between threads
+constexpr int64_t MinRowsPerPermuteRange = 1 << 16;
+
+// how many indices ahead the gathered values are prefetched
+constexpr int64_t PrefetchDistance = 16;
+
+// Chunks of the source column flattened into plain tables, so that locating the chunk of a row
+// is a search over a few integers instead of going through arrow objects.
+struct ChunkTable
+{
+    std::vector<int64_t> starts; // index of the first row of each chunk, total length at the end
+    std::vector<const arrow::Array *> chunks;
+    std::vector<const uint8_t *> bitmaps; // null when chunk has no nulls
+    std::vector<int64_t> bitmapOffsets;
+
+    explicit ChunkTable(const arrow::ChunkedArray &array)
     {
-        CASE_DISPATCH(SortOrder::Ascending);
-        CASE_DISPATCH(SortOrder::Descending);
-    default: throw std::runtime_error(__FUNCTION__ + ": invalid value"s);
+        starts.push_back(0);
+        for(auto &chunk : array.chunks())
+        {
+            starts.push_back(starts.back() + chunk->length());
+            chunks.push_back(chunk.get());
+            bitmaps.push_back(chunk->null_count() ? chunk->null_bitmap_data() : nullptr);
+            bitmapOffsets.push_back(chunk->offset());
+        }
     }
-}
-template<typename F>
-auto dispatch(NullPosition nullPosition, F &&f)
+
+    // Index of chunk containing the row. Indices often come in runs from the same chunk,
+    // so the previously found chunk is checked first.
+    int64_t locate(int64_t row, int64_t previousChunk) const
+    {
+        if(row >= starts[previousChunk] && row < starts[previousChunk + 1])
+            return previousChunk;
+        return std::upper_bound(starts.begin(), starts.end(), row) - starts.begin() - 1;
+    }
+
+    bool isValid(int64_t chunk, int64_t row) const
+    {
+        const auto bitmap = bitmaps[chunk];
+        return !bitmap || arrow::BitUtil::GetBit(bitmap, bitmapOffsets[chunk] + row - starts[chunk]);
+    }
+};
+
+// Gathers validity bits of given rows into a new bitmap, 64 rows at a time.
+// Returns null buffer when source has no nulls.
+std::pair<std::shared_ptr<arrow::Buffer>, int64_t> gatherValidity(const ChunkTable &chunks, const int64_t *indices, int64_t count)
 {
-    switch(nullPosition)
+    if(std::all_of(chunks.bitmaps.begin(), chunks.bitmaps.end(), [] (auto *bitmap) { return bitmap == nullptr; }))
+        return { nullptr, 0 };
+
+    auto [buffer, bitmap] = allocateBuffer<uint8_t>(arrow::BitUtil::BytesForBits(count));
+    int64_t nullCount = 0;
+    int64_t chunk = 0;
+    for(int64_t wordStart = 0; wordStart < count; wordStart += 64)
     {
-        CASE_DISPATCH(NullPosition::Before);
-        CASE_DISPATCH(NullPosition::After);
-    default: throw std::runtime_error(__FUNCTION__ + ": invalid value"s);
+        const auto wordEnd = std::min(count, wordStart + 64);
+        uint64_t word = 0;
+        for(int64_t i = wordStart; i < wordEnd; i++)
+        {
+            chunk = chunks.locate(indices[i], chunk);
+            word |= uint64_t(chunks.isValid(chunk, indices[i])) << (i - wordStart);
+        }
+        nullCount += (wordEnd - wordStart) - popCount(word);
+        // arrow bitmaps are little-endian, the same as the word
+        std::memcpy(bitmap + wordStart / 8, &word, arrow::BitUtil::BytesForBits(wordEnd - wordStart));
     }
+    return { buffer, nullCount };
 }
 
-namespace
+template<typename T>
+void gatherFromSingleChunk(const T *values, const int64_t *indices, int64_t count, T * __restrict target)
 {
+    for(int64_t i = 0; i < count; i++)
+    {
+        if(i + PrefetchDistance < count)
+            prefetch(values + indices[i + PrefetchDistance]);
+        target[i] = values[indices[i]];
+    }
+}
 
-template<typename ArrowType, bool nullable>
-struct ColumnPermuter
+template<arrow::Type::type id>
+std::shared_ptr<arrow::Array> gatherFixedWidth(const arrow::Column &column, const int64_t *indices, int64_t count)
 {
-    static constexpr arrow::Type::type id = ArrowType::type_id;
+    using T = typename TypeDescription<id>::StorageValueType;
+    using Array = typename TypeDescription<id>::Array;
+
+    const ChunkTable chunks{ *column.data() };
+    const auto values = transformToVector(chunks.chunks, [] (const arrow::Array *chunk)
+    {
+        return static_cast<const Array *>(chunk)->raw_values();
+    });
+
+    auto [valueBuffer, target] = allocateBuffer<T>(count);
+    if(values.size() == 1)
+    {
+        gatherFromSingleChunk(values.front(), indices, count, target);
+    }
+    else
+    {
+        int64_t chunk = 0;
+        for(int64_t i = 0; i < count; i++)
+        {
+            chunk = chunks.locate(indices[i], chunk);
+            target[i] = values[chunk][indices[i] - chunks.starts[chunk]];
+        }
+    }
 
-    std::shared_ptr<arrow::Column> column;
-    std::shared_ptr<ArrowType> type;
-    Permutation indices;
+    auto [bitmap, nullCount] = gatherValidity(chunks, indices, count);
+    return std::make_shared<Array>(column.type(), count, valueBuffer, bitmap, nullCount);
+}
 
-    ColumnPermuter(std::shared_ptr<arrow::Column> column, std::shared_ptr<ArrowType> type, Permutation indices, std::bool_constant<nullable> n={})
-        : column(std::move(column))
-        , type(std::move(type))
-        , indices(std::move(indices))
-    {}
+// Strings are gathered in two passes: the first one computes offsets (and so the total size),
+// the second one copies the characters into a buffer allocated once.
+std::shared_ptr<arrow::Array> gatherStrings(const arrow::Column &column, const int64_t *indices, int64_t count)
+{
+    if(count > std::numeric_limits<int32_t>::max())
+        throw std::runtime_error("not implemented: too big array");
 
-    std::shared_ptr<arrow::Array> operator()() const
+    const ChunkTable chunks{ *column.data() };
+    const auto offsets = transformToVector(chunks.chunks, [] (const arrow::Array *chunk)
     {
-        if(column->length() > std::numeric_limits<int32_t>::max())
-            throw std::runtime_error("not implemented: too big array");
+        return static_cast<const arrow::StringArray *>(chunk)->raw_value_offsets();
+    });
+    const auto data = transformToVector(chunks.chunks, [] (const arrow::Array *chunk)
+    {
+        const auto valueData = static_cast<const arrow::StringArray *>(chunk)->value_data();
+        return valueData ? valueData->data() : nullptr;
+    });
 
-        using T = typename TypeDescription<ArrowType::type_id>::StorageValueType;
+    auto [bitmap, nullCount] = gatherValidity(chunks, indices, count);
+    const auto isValid = [&, bitmap = bitmap.get()] (int64_t i)
+    {
+        return !bitmap || arrow::BitUtil::GetBit(bitmap->data(), i);
+    };
 
-        const auto length = (int32_t)column->length();
+    auto [offsetsBuffer, targetOffsets] = allocateBuffer<int32_t>(count + 1);
+    int64_t totalLength = 0;
+    int64_t chunk = 0;
+    targetOffsets[0] = 0;
+    for(int64_t i = 0; i < count; i++)
+    {
+        if(i + PrefetchDistance < count && offsets.size() == 1)
+            prefetch(offsets.front() + indices[i + PrefetchDistance]);
 
-        const ChunkAccessor chunks{ *column->data() };
-        if constexpr(!nullable && (id == arrow::Type::INT64 || id == arrow::Type::DOUBLE))
+        chunk = chunks.locate(indices[i], chunk);
+        if(isValid(i))
         {
-            FixedSizeArrayBuilder<id, nullable> b{ type, length };
-            {
-                T * __restrict target = b.nextValueToWrite;
-                for(auto index : indices)
-                {
-                    const auto[chunk, indexInChunk] = chunks.locate(index);
-                    const auto value = arrayValueAt<id>(*chunk, indexInChunk);
-                    // unfortunately gives performance edge over b.Append(value)
-                    // TODO: can we have something nice and fast?
-                    *target++ = value;
-                }
-            }
-            return b.Finish();
+            const auto indexInChunk = indices[i] - chunks.starts[chunk];
+            totalLength += offsets[chunk][indexInChunk + 1] - offsets[chunk][indexInChunk];
+            if(totalLength > std::numeric_limits<int32_t>::max())
+                THROW("permuted strings would take {} bytes, more than a single array can hold", totalLength);
         }
-        else
-        {
-            auto b = makeBuilder(type);
-            b->Reserve(indices.size());
-            for(auto index : indices)
-            {
-                const auto[chunk, indexInChunk] = chunks.locate(index);
-                if constexpr(nullable)
-                {
-                    if(chunk->IsValid(indexInChunk))
-                    {
-                        const auto value = arrayValueAt<id>(*chunk, indexInChunk);
-                        append(*b, value);
-                    }
-                    else
-                        b->AppendNull();
-                }
-                else
-                    append(*b, arrayValueAt<id>(*chunk, indexInChunk));
-            }
+        targetOffsets[i + 1] = static_cast<int32_t>(totalLength);
+    }
 
-            return finish(*b);
-        }
+    auto [dataBuffer, targetData] = allocateBuffer<uint8_t>(totalLength);
+    chunk = 0;
+    for(int64_t i = 0; i < count; i++)
+    {
+        const auto length = targetOffsets[i + 1] - targetOffsets[i];
+        if(length == 0)
+            continue;
+
+        chunk = chunks.locate(indices[i], chunk);
+        const auto indexInChunk = indices[i] - chunks.starts[chunk];
+        std::memcpy(targetData + targetOffsets[i], data[chunk] + offsets[chunk][indexInChunk], length);
     }
-};
 
+    return std::make_shared<arrow::StringArray>(count, offsetsBuffer, dataBuffer, bitmap, nullCount);
+}
 
+// Gathers values of column at given indices into a new array.
+std::shared_ptr<arrow::Array> permuteInnerToArray(const arrow::Column &column, const int64_t *indices, int64_t count)
+{
+    return visitType(*column.type(), [&] (auto id) -> std::shared_ptr<arrow::Array>
+    {
+        if constexpr(id.value == arrow::Type::STRING)
+            return gatherStrings(column, indices, count);
+        else
+            return gatherFixedWidth<id.value>(column, indices, count);
+    });
+}
 
 std::shared_ptr<arrow::Array> permuteInnerToArray(std::shared_ptr<arrow::Column> column, const Permutation &indices)
 {
-    return visitDataType3(column->type(), [&](auto &&datatype)
+    return permuteInnerToArray(*column, indices.data(), indices.size());
+}
+
+// Permutes columns in parallel: every column is split into row ranges, each (column, range)
+// pair is a separate task producing one chunk of the resulting column.
+std::vector<std::shared_ptr<arrow::Column>> permuteInner(const std::vector<std::shared_ptr<arrow::Column>> &columns, const Permutation &indices)
+{
+    const auto length = (int64_t)indices.size();
+    const auto rangeCount = parallelRangeCount(length, MinRowsPerPermuteRange);
+    const auto columnCount = (int64_t)columns.size();
+
+    std::vector<arrow::ArrayVector> chunks(columnCount, arrow::ArrayVector(rangeCount));
+    parallelFor(columnCount * rangeCount, [&] (int64_t task)
     {
-        return dispatch(column->null_count() != 0, [&](auto nullable)
-        {
-            using ArrowType = typename std::decay_t<decltype(datatype)>::element_type;
-            return ColumnPermuter<ArrowType, nullable.value>(column, datatype, indices)();
-        });
+        const auto columnIndex = task / rangeCount;
+        const auto rangeIndex = task % rangeCount;
+        const auto [begin, end] = rangeBounds(length, rangeCount, rangeIndex);
+        chunks[columnIndex][rangeIndex] = permuteInnerToArray(*columns[columnIndex], indices.data() + begin, end - begin);
     });
+
+    std::vector<std::shared_ptr<arrow::Column>> ret;
+    for(int64_t i = 0; i < columnCount; i++)
+        ret.push_back(std::make_shared<arrow::Column>(gatheredField(*columns[i], indices), chunks[i]));
+    return ret;
 }
 
 std::shared_ptr<arrow::Column> permuteInner(std::shared_ptr<arrow::Column> column, const Permutation &indices)
 {
-    return std::make_shared<arrow::Column>(column->field(), permuteInnerToArray(column, indices));
+    return permuteInner(std::vector<std::shared_ptr<arrow::Column>>{ column }, indices).front();
 }
 
 std::shared_ptr<arrow::Table> permuteInner(std::shared_ptr<arrow::Table> table, const Permutation &indices)
 {
-    auto oldColumns = getColumns(*table);
-    auto newColumns = transformToVector(oldColumns, [&](auto &&col) { return permuteInner(col, indices); });
-    return arrow::Table::Make(table->schema(), newColumns);
+    auto newColumns = permuteInner(getColumns(*table), indices);
+    return tableWithColumns(*table, newColumns);
 }
 
-bool isPermuteId(const Permutation &indices)
+// whether indices select all of length rows in their original order
+bool isPermuteId(const Permutation &indices, int64_t length)
 {
+    if((int64_t)indices.size() != length)
+        return false;
     for(auto i = 0_z; i < indices.size(); i++)
         if(indices[i] != i)
             return false;
     return true;
 }
 
-template<arrow::Type::type id, bool nullable, SortOrder order, NullPosition nulls>
-void sortPermutationInner(Permutation &indices, const arrow::Column &sortBy)
+// One component of a normalized sort key. Codes are unsigned integers whose natural order
+// is the requested order of rows, with sort order and null position already applied.
+struct KeyComponent
 {
-    // Note: Measures shown that it is usually much faster to copy data into vector
-    // rather than keep it in array and each time lookup index for the given chunk.
-    //
-    // For now this is simple and fast enough.
-    using ElementType = typename TypeDescription<id>::ObservedType;
-    using ActualObservedType = std::conditional_t<nullable, std::optional<ElementType>, ElementType>;
+    std::vector<uint64_t> codes;
+    int bitWidth = 0; // all codes fit in this many lowest bits
+
+    // Long strings are not fully described by their codes: rows with equal codes need
+    // their values compared.
+    bool exact = true;
+    std::vector<std::optional<std::string_view>> strings;
+    SortOrder order = SortOrder::Ascending;
+    NullPosition nulls = NullPosition::Before;
+};
 
-    const auto compareRawValues = [](ElementType lhs, ElementType rhs)
+int bitWidthOf(uint64_t maxCode)
+{
+    int bits = 0;
+    while(bits < 64 && (maxCode >> bits))
+        ++bits;
+    return bits;
+}
+
+// Unsigned integer with the same order as the given value.
+template<arrow::Type::type id>
+uint64_t orderedBits(uint64_t keyBits)
+{
+    if constexpr(id == arrow::Type::DOUBLE)
+    {
+        // IEEE 754: negative values need all bits flipped, non-negative just the sign bit
+        const uint64_t signBit = uint64_t(1) << 63;
+        return (keyBits & signBit) ? ~keyBits : keyBits ^ signBit;
+    }
+    else
     {
-        if constexpr(order == SortOrder::Ascending)
-            return lhs < rhs;
+        // with flipped sign bit, unsigned order of integers matches the signed one
+        return keyBits ^ (uint64_t(1) << 63);
+    }
+}
+
+// Encodes fixed width values as their rank relative to the minimum value, so small ranges take
+// only few bits of the packed key. Usually this is a single component, only when values span
+// the whole 64-bit range the null flag has to be put in a component of its own.
+template<arrow::Type::type id>
+void encodeFixedWidthKey(std::vector<uint64_t> keys, const std::vector<uint8_t> &valid, SortOrder order, NullPosition nulls, std::vector<KeyComponent> &out)
+{
+    const auto N = keys.size();
+    auto minKey = std::numeric_limits<uint64_t>::max();
+    auto maxKey = std::numeric_limits<uint64_t>::min();
+    bool hasNulls = false;
+    for(size_t row = 0; row < N; row++)
+    {
+        if(valid[row])
+        {
+            keys[row] = orderedBits<id>(keys[row]);
+            minKey = std::min(minKey, keys[row]);
+            maxKey = std::max(maxKey, keys[row]);
+        }
         else
-            return lhs > rhs;
-    };
+            hasNulls = true;
+    }
+
+    KeyComponent values;
+    if(minKey > maxKey) // only nulls
+    {
+        values.codes.resize(N);
+        out.push_back(std::move(values));
+        return;
+    }
 
-    const auto compareValues = [=](auto &&lhs, auto &&rhs)
+    const auto range = maxKey - minKey;
+    const bool nullsFirst = nulls == NullPosition::Before;
+    const bool separateNullFlag = hasNulls && range == std::numeric_limits<uint64_t>::max();
+    const uint64_t validOffset = hasNulls && nullsFirst && !separateNullFlag ? 1 : 0;
+    const uint64_t nullCode = nullsFirst || separateNullFlag ? 0 : range + 1;
+    for(size_t row = 0; row < N; row++)
     {
+        if(valid[row])
+        {
+            const auto rank = keys[row] - minKey;
+            keys[row] = (order == SortOrder::Ascending ? rank : range - rank) + validOffset;
+        }
+        else
+            keys[row] = nullCode;
+    }
+
+    if(separateNullFlag)
+    {
+        KeyComponent nullFlag;
+        nullFlag.codes.resize(N);
+        for(size_t row = 0; row < N; row++)
+            nullFlag.codes[row] = (valid[row] != 0) == nullsFirst;
+        nullFlag.bitWidth = 1;
+        out.push_back(std::move(nullFlag));
+    }
+
+    values.bitWidth = bitWidthOf(range + validOffset + (hasNulls && !nullsFirst && !separateNullFlag));
+    values.codes = std::move(keys);
+    out.push_back(std::move(values));
+}
 
-        if constexpr(nullable)
+// First 8 bytes of string as big-endian integer (zero padded), so integer order is the byte-wise order.
+uint64_t stringPrefixCode(std::string_view value)
+{
+    uint64_t code = 0;
+    for(size_t i = 0; i < 8; i++)
+        code = (code << 8) | (i < value.size() ? static_cast<uint8_t>(value[i]) : 0);
+    return code;
+}
+
+// Strings are represented by their prefixes, only rows with equal prefixes need to compare
+// whole strings. When all strings fit in the prefix (and have no zero bytes that would be
+// confused with padding), prefixes are exact and strings are not needed at all.
+void encodeStringKey(std::vector<std::optional<std::string_view>> strings, SortOrder order, NullPosition nulls, std::vector<KeyComponent> &out)
+{
+    const auto length = strings.size();
+    const bool descending = order == SortOrder::Descending;
+
+    KeyComponent prefixes;
+    prefixes.codes.resize(length);
+    prefixes.bitWidth = 64;
+    prefixes.order = order;
+    prefixes.nulls = nulls;
+
+    bool hasNulls = false;
+    bool fitInPrefix = true;
+    for(size_t row = 0; row < length; row++)
+    {
+        if(const auto &value = strings[row])
         {
-            const auto lhsValid = lhs.has_value();
-            const auto rhsValid = rhs.has_value();
-            if(lhsValid && rhsValid)
-                return compareRawValues(*lhs, *rhs);
-            if(!lhsValid && !rhsValid) // null < null
-                return false;
-            if(lhsValid) // lhs < null
-                return nulls == NullPosition::After;
-            if(rhsValid) // rhs < null
-                return nulls == NullPosition::Before;
+            fitInPrefix = fitInPrefix && value->size() <= 8 && value->find('\0') == std::string_view::npos;
+            const auto code = stringPrefixCode(*value);
+            prefixes.codes[row] = descending ? ~code : code;
+        }
+        else
+            hasNulls = true;
+    }
 
-            throw std::runtime_error("sort internal error");
+    // nulls are ordered by their own component, as any prefix code may belong to a valid string
+    if(hasNulls)
+    {
+        KeyComponent nullFlag;
+        nullFlag.codes.resize(length);
+        for(size_t row = 0; row < length; row++)
+            nullFlag.codes[row] = strings[row].has_value() == (nulls == NullPosition::Before);
+        nullFlag.bitWidth = 1;
+        out.push_back(std::move(nullFlag));
+    }
+
+    prefixes.exact = fitInPrefix;
+    if(!prefixes.exact)
+        prefixes.strings = std::move(strings);
+    out.push_back(std::move(prefixes));
+}
+
+void encodeSortKey(const SortBy &sortBy, std::vector<KeyComponent> &out)
+{
+    visitType(*sortBy.column->type(), [&] (auto id)
+    {
+        if constexpr(id.value == arrow::Type::STRING)
+        {
+            encodeStringKey(toVector<std::optional<std::string_view>>(*sortBy.column), sortBy.order, sortBy.nulls, out);
         }
         else
         {
-            return compareRawValues(lhs, rhs);
+            auto [keys, valid] = readGroupKeys<id.value>(*sortBy.column);
+            encodeFixedWidthKey<id.value>(std::move(keys), valid, sortBy.order, sortBy.nulls, out);
         }
+    });
+}
+
+// negative when lhs should go before rhs, positive when after
+int compareStrings(const KeyComponent &component, int64_t lhs, int64_t rhs)
+{
+    const auto &lhsValue = component.strings[lhs];
+    const auto &rhsValue = component.strings[rhs];
+    if(lhsValue && rhsValue)
+    {
+        const auto result = lhsValue->compare(*rhsValue);
+        return component.order == SortOrder::Ascending ? result : -result;
+    }
+    if(lhsValue == rhsValue) // both null
+        return 0;
+
+    const int nullSign = component.nulls == NullPosition::Before ? -1 : 1;
+    return lhsValue ? -nullSign : nullSign;
+}
+
+template<size_t Words>
+struct SortEntry
+{
+    std::array<uint64_t, Words> prefix{};
+    int64_t row;
+};
+
+// below that std::sort is faster than radix passes with their histograms
+constexpr int64_t MinRowsForRadixSort = 1 << 10;
+constexpr int RadixBits = 11;
+constexpr int RadixBuckets = 1 << RadixBits;
+
+// below that many rows sorting is not split between threads
+constexpr int64_t MinRowsPerSortRange = 1 << 16;
+
+// LSD radix sort by the whole prefix, starting from the least significant used digit.
+// Each pass is stable, so rows with equal prefixes keep their order. Passes where all
+// entries fall into a single bucket are skipped.
+template<size_t Words>
+void radixSortEntries(SortEntry<Words> *entries, int64_t length, const std::array<int, Words> &unusedLowBits)
+{
+    struct Pass
+    {
+        size_t word;
+        int shift;
     };
+    std::vector<Pass> passes;
+    for(size_t word = Words; word-- > 0; )
+        for(int shift = unusedLowBits[word]; shift < 64; shift += RadixBits)
+            passes.push_back(Pass{word, shift});
+
+    // histograms for all passes are gathered in a single read of entries
+    std::vector<std::array<int64_t, RadixBuckets>> counts(passes.size());
+    for(auto &histogram : counts)
+        histogram.fill(0);
+    for(int64_t i = 0; i < length; i++)
+        for(size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+            ++counts[passIndex][(entries[i].prefix[passes[passIndex].word] >> passes[passIndex].shift) & (RadixBuckets - 1)];
+
+    std::vector<SortEntry<Words>> buffer(length);
+    auto source = entries;
+    auto target = buffer.data();
+    for(size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+    {
+        const auto [word, shift] = passes[passIndex];
+        auto &histogram = counts[passIndex];
+        if(std::find(histogram.begin(), histogram.end(), length) != histogram.end())
+            continue;
 
-    // TODO: special faster path (no-copy) can be provided for single chunk columns
-    // however gains will rather be limited, as sorting and permuting data dominates
-    const auto valuesAsVector = toVector<ActualObservedType>(sortBy);
-    std::stable_sort(indices.begin(), indices.end(), [&](int64_t lhsIndex, int64_t rhsIndex)
+        int64_t offset = 0;
+        for(auto &count : histogram)
+        {
+            const auto bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+
+        for(int64_t i = 0; i < length; i++)
+            target[histogram[(source[i].prefix[word] >> shift) & (RadixBuckets - 1)]++] = source[i];
+        std::swap(source, target);
+    }
+
+    if(source != entries)
+        std::copy(source, source + length, entries);
+}
+
+// Merges rangeCount consecutive sorted ranges of entries, returning rows in the merged order.
+// Output is split into parts by splitters sampled from the ranges: each part gathers its share
+// of every range (found by binary search) and is merged independently.
+template<typename Entry, typename Less>
+Permutation mergeSortedRanges(const std::vector<Entry> &entries, int64_t rangeCount, Less isBefore)
+{
+    const auto length = (int64_t)entries.size();
+    const auto partCount = rangeCount;
+    constexpr int64_t SamplesPerPart = 16;
+
+    std::vector<Entry> samples;
+    for(int64_t range = 0; range < rangeCount; range++)
+    {
+        const auto [begin, end] = rangeBounds(length, rangeCount, range);
+        const auto sampleCount = std::min(end - begin, SamplesPerPart * partCount);
+        for(int64_t i = 0; i < sampleCount; i++)
+            samples.push_back(entries[begin + (end - begin) * i / sampleCount]);
+    }
+    std::sort(samples.begin(), samples.end(), isBefore);
+
+    // cuts[range][part] -- where the part starts within the sorted range
+    std::vector<std::vector<int64_t>> cuts(rangeCount, std::vector<int64_t>(partCount + 1));
+    parallelFor(rangeCount, [&] (int64_t range)
     {
-        const auto &lhs = valuesAsVector[lhsIndex];
-        const auto &rhs = valuesAsVector[rhsIndex];
-        return compareValues(lhs, rhs);
+        const auto [begin, end] = rangeBounds(length, rangeCount, range);
+        cuts[range][0] = begin;
+        cuts[range][partCount] = end;
+        for(int64_t part = 1; part < partCount; part++)
+        {
+            const auto &splitter = samples[samples.size() * part / partCount];
+            cuts[range][part] = std::lower_bound(entries.begin() + cuts[range][part - 1], entries.begin() + end, splitter, isBefore) - entries.begin();
+        }
     });
+
+    std::vector<int64_t> partStarts(partCount + 1);
+    for(int64_t part = 0; part < partCount; part++)
+    {
+        partStarts[part + 1] = partStarts[part];
+        for(int64_t range = 0; range < rangeCount; range++)
+            partStarts[part + 1] += cuts[range][part + 1] - cuts[range][part];
+    }
+
+    Permutation ret(length);
+    parallelFor(partCount, [&] (int64_t part)
+    {
+        using Cursor = std::pair<const Entry *, const Entry *>;
+        std::vector<Cursor> cursors;
+        for(int64_t range = 0; range < rangeCount; range++)
+            if(cuts[range][part] < cuts[range][part + 1])
+                cursors.emplace_back(entries.data() + cuts[range][part], entries.data() + cuts[range][part + 1]);
+
+        // heap with the smallest entry on top
+        const auto isAfter = [&] (const Cursor &lhs, const Cursor &rhs) { return isBefore(*rhs.first, *lhs.first); };
+        std::make_heap(cursors.begin(), cursors.end(), isAfter);
+
+        auto output = ret.data() + partStarts[part];
+        while(!cursors.empty())
+        {
+            std::pop_heap(cursors.begin(), cursors.end(), isAfter);
+            auto &cursor = cursors.back();
+            *output++ = cursor.first->row;
+            if(++cursor.first == cursor.second)
+                cursors.pop_back();
+            else
+                std::push_heap(cursors.begin(), cursors.end(), isAfter);
+        }
+    });
+    return ret;
 }
 
-void sortPermutation(Permutation &indices, const arrow::Column &sortBy, SortOrder order, NullPosition nullPosition)
+// Sorts rows by prefixes packed from leading key components. Only rows with equal prefixes
+// look at the remaining components (starting from fallbackStart). Ties are resolved by
+// the original row index, so the sort is stable. Large inputs are sorted in ranges
+// by all workers and then merged.
+template<size_t Words>
+Permutation sortByNormalizedKeys(const std::vector<KeyComponent> &components, int64_t length)
 {
-    // Hoist runtime constant values to the compile-time values.
-    visitType(*sortBy.type(), [&] (auto id)
+    // where each packed component lands in the prefix
+    struct Placement
+    {
+        size_t component;
+        size_t word;
+        int shift;
+    };
+    std::vector<Placement> placements;
+
+    size_t fallbackStart = components.size();
+    size_t word = 0;
+    int bitsLeft = 64;
+    std::array<int, Words> unusedLowBits;
+    unusedLowBits.fill(64);
+    for(size_t i = 0; i < components.size(); i++)
     {
-        dispatch(nullPosition, [&] (auto nullPosition)
+        const auto &component = components[i];
+        if(component.bitWidth > bitsLeft)
         {
-            dispatch(order, [&] (auto orderC)
+            // components are not split between words
+            if(++word == Words)
             {
-                dispatch(sortBy.null_count() != 0, [&] (auto hasNullsC)
-                {
-                    sortPermutationInner<id.value, hasNullsC.value, orderC.value, nullPosition.value>(indices, sortBy);
-                });
+                fallbackStart = i;
+                break;
+            }
+            bitsLeft = 64;
+        }
+
+        if(component.bitWidth)
+        {
+            bitsLeft -= component.bitWidth;
+            unusedLowBits[word] = bitsLeft;
+            placements.push_back(Placement{i, word, bitsLeft});
+        }
+
+        // components after inexact one would be compared out of order
+        if(!component.exact)
+        {
+            fallbackStart = i;
+            break;
+        }
+    }
+
+    const auto isBefore = [&] (const SortEntry<Words> &lhs, const SortEntry<Words> &rhs)
+    {
+        if(lhs.prefix != rhs.prefix)
+            return lhs.prefix < rhs.prefix;
+
+        for(size_t i = fallbackStart; i < components.size(); i++)
+        {
+            const auto &component = components[i];
+            const auto lhsCode = component.codes[lhs.row];
+            const auto rhsCode = component.codes[rhs.row];
+            if(lhsCode != rhsCode)
+                return lhsCode < rhsCode;
+            if(!component.exact)
+                if(const auto result = compareStrings(component, lhs.row, rhs.row))
+                    return result < 0;
+        }
+        return lhs.row < rhs.row;
+    };
+
+    // When prefixes describe keys completely (numeric and timestamp keys that fit, short strings),
+    // sorting doesn't need comparisons at all. Otherwise rows are radix sorted by prefix first
+    // and only runs of rows with equal prefixes are sorted by comparing remaining keys.
+    const bool prefixIsExact = fallbackStart == components.size();
+    const bool useRadixSort = !placements.empty();
+
+    std::vector<SortEntry<Words>> entries(length);
+    const auto rangeCount = parallelRangeCount(length, MinRowsPerSortRange);
+    parallelForRanges(length, rangeCount, [&] (int64_t rangeIndex, int64_t begin, int64_t end)
+    {
+        for(int64_t row = begin; row < end; row++)
+            entries[row].row = row;
+        for(auto &placement : placements)
+        {
+            const auto &codes = components[placement.component].codes;
+            for(int64_t row = begin; row < end; row++)
+                entries[row].prefix[placement.word] |= codes[row] << placement.shift;
+        }
+
+        if(!useRadixSort || end - begin < MinRowsForRadixSort)
+        {
+            std::sort(entries.begin() + begin, entries.begin() + end, isBefore);
+            return;
+        }
+
+        radixSortEntries(entries.data() + begin, end - begin, unusedLowBits);
+        if(prefixIsExact)
+            return;
+
+        for(auto runStart = entries.begin() + begin; runStart != entries.begin() + end; )
+        {
+            const auto runEnd = std::find_if(runStart + 1, entries.begin() + end, [&] (auto &&entry)
+            {
+                return entry.prefix != runStart->prefix;
             });
-        });
+            if(runEnd - runStart > 1)
+                std::sort(runStart, runEnd, isBefore);
+            runStart = runEnd;
+        }
     });
+
+    if(rangeCount > 1)
+        return mergeSortedRanges(entries, rangeCount, isBefore);
+
+    return transformToVector(entries, [] (auto &&entry) { return entry.row; });
 }
 
-std::vector<int64_t> sortPermutation(std::vector<SortBy> sortBy)
+std::vector<int64_t> sortPermutation(const std::vector<SortBy> &sortBy)
 {
     if(sortBy.empty())
         throw std::runtime_error("no column to sort by");
 
-    Permutation indices = iotaVector<int64_t>(sortBy.front().column->length());
+    const auto length = sortBy.front().column->length();
+    for(auto &key : sortBy)
+        if(key.column->length() != length)
+            THROW("column to sort by `{}` has length {}, expected {}", key.column->name(), key.column->length(), length);
+
+    // keys are encoded independently of each other
+    std::vector<std::vector<KeyComponent>> componentsPerKey(sortBy.size());
+    parallelFor(sortBy.size(), [&] (int64_t i)
+    {
+        encodeSortKey(sortBy[i], componentsPerKey[i]);
+    });
+
+    std::vector<KeyComponent> components;
+    for(auto &keyComponents : componentsPerKey)
+        for(auto &component : keyComponents)
+            components.push_back(std::move(component));
 
-    std::reverse(sortBy.begin(), sortBy.end());
-    for(auto &sortBy : sortBy)
+    // two words only if the leading exact components don't fit in one
+    int leadingBits = 0;
+    for(auto &component : components)
     {
-        sortPermutation(indices, *sortBy.column, sortBy.order, sortBy.nulls);
+        leadingBits += component.bitWidth;
+        if(!component.exact)
+            break;
     }
 
-    return indices;
+    if(leadingBits > 64)
+        return sortByNormalizedKeys<2>(components, length);
+    return sortByNormalizedKeys<1>(components, length);
+}
+
+
+// rows of a single thread's range are read in blocks of that size
+constexpr int64_t TopRowsBlockSize = 1 << 12;
+
+// Value of a sort key in a single row, comparable without looking at the column again.
+struct RowKeyValue
+{
+    uint8_t rank = 0; // orders nulls relative to valid values
+    uint64_t code = 0; // order-preserving code of fixed width value or string prefix
+    std::string_view text; // string value
+};
+
+// negative when lhs goes before rhs, positive when after
+int compareKeyValues(const RowKeyValue &lhs, const RowKeyValue &rhs, SortOrder order)
+{
+    if(lhs.rank != rhs.rank)
+        return lhs.rank < rhs.rank ? -1 : 1;
+    if(lhs.code != rhs.code)
+        return lhs.code < rhs.code ? -1 : 1;
+    const auto result = lhs.text.compare(rhs.text);
+    return order == SortOrder::Ascending ? result : -result;
+}
+
+// Reads values of the key for rows starting at begin, as many as fit in values.
+void readKeyValues(const SortBy &key, int64_t begin, std::vector<RowKeyValue> &values)
+{
+    const auto slice = key.column->Slice(begin, values.size());
+    const uint8_t nullRank = key.nulls == NullPosition::Before ? 0 : 2;
+    const bool descending = key.order == SortOrder::Descending;
+    visitType(*key.column->type(), [&] (auto id)
+    {
+        auto out = values.begin();
+        iterateOver<id.value>(*slice,
+            [&] (auto &&value)
+            {
+                if constexpr(id.value == arrow::Type::STRING)
+                {
+                    const auto code = stringPrefixCode(value);
+                    *out++ = RowKeyValue{1, descending ? ~code : code, value};
+                }
+                else
+                {
+                    uint64_t bits;
+                    if constexpr(id.value == arrow::Type::DOUBLE)
+                        bits = normalizedKeyBits(value);
+                    else
+                        bits = static_cast<uint64_t>(toStorage(value));
+
+                    const auto code = orderedBits<id.value>(bits);
+                    *out++ = RowKeyValue{1, descending ? ~code : code, {}};
+                }
+            },
+            [&]
+            {
+                *out++ = RowKeyValue{nullRank, 0, {}};
+            });
+    });
+}
+
+struct TopCandidate
+{
+    int64_t row;
+    std::vector<RowKeyValue> keys;
+};
+
+// Best count rows out of [begin, end), in no particular order. Keeps a bounded heap with the
+// worst candidate on top, so most rows are rejected after a single comparison.
+std::vector<TopCandidate> selectTopCandidates(const std::vector<SortBy> &sortBy, int64_t begin, int64_t end, int64_t count)
+{
+    const auto keyCount = sortBy.size();
+    const auto compareRow = [&] (const auto &lhsKeyAt, int64_t lhsRow, const TopCandidate &rhs)
+    {
+        for(size_t key = 0; key < keyCount; key++)
+            if(const auto result = compareKeyValues(lhsKeyAt(key), rhs.keys[key], sortBy[key].order))
+                return result < 0;
+        return lhsRow < rhs.row;
+    };
+    const auto isBefore = [&] (const TopCandidate &lhs, const TopCandidate &rhs)
+    {
+        return compareRow([&] (size_t key) -> auto& { return lhs.keys[key]; }, lhs.row, rhs);
+    };
+
+    std::vector<TopCandidate> heap;
+    if(count == 0)
+        return heap;
+
+    heap.reserve(count);
+    std::vector<std::vector<RowKeyValue>> block(keyCount);
+    for(int64_t blockStart = begin; blockStart < end; blockStart += TopRowsBlockSize)
+    {
+        const auto blockLength = std::min(TopRowsBlockSize, end - blockStart);
+        for(size_t key = 0; key < keyCount; key++)
+        {
+            block[key].resize(blockLength);
+            readKeyValues(sortBy[key], blockStart, block[key]);
+        }
+
+        for(int64_t i = 0; i < blockLength; i++)
+        {
+            const auto keyAt = [&] (size_t key) -> auto& { return block[key][i]; };
+            if((int64_t)heap.size() == count)
+            {
+                if(!compareRow(keyAt, blockStart + i, heap.front()))
+                    continue;
+                std::pop_heap(heap.begin(), heap.end(), isBefore);
+            }
+            else
+            {
+                heap.push_back(TopCandidate{0, std::vector<RowKeyValue>(keyCount)});
+            }
+
+            auto &candidate = heap.back();
+            candidate.row = blockStart + i;
+            for(size_t key = 0; key < keyCount; key++)
+                candidate.keys[key] = keyAt(key);
+            std::push_heap(heap.begin(), heap.end(), isBefore);
+        }
+    }
+    return heap;
 }
 
 }
@@ -220,7 +848,7 @@ std::vector<int64_t> sortPermutation(std::vector<SortBy> sortBy)
 
 std::shared_ptr<arrow::Array> permuteToArray(const std::shared_ptr<arrow::Column> &column, const Permutation &indices)
 {
-    if(isPermuteId(indices) && column->data()->num_chunks() == 1)
+    if(isPermuteId(indices, column->length()) && column->data()->num_chunks() == 1)
         return column->data()->chunk(0);
 
     return permuteInnerToArray(column, indices);
@@ -228,7 +856,7 @@ std::shared_ptr<arrow::Array> permuteToArray(const std::shared_ptr<arrow::Column
 
 std::shared_ptr<arrow::Column> permute(const std::shared_ptr<arrow::Column> &column, const Permutation &indices)
 {
-    if(isPermuteId(indices))
+    if(isPermuteId(indices, column->length()))
         return column;
 
     return permuteInner(column, indices);
@@ -236,7 +864,7 @@ std::shared_ptr<arrow::Column> permute(const std::shared_ptr<arrow::Column> &col
 
 std::shared_ptr<arrow::Table> permute(const std::shared_ptr<arrow::Table> &table, const Permutation &indices)
 {
-    if(isPermuteId(indices))
+    if(isPermuteId(indices, table->num_rows()))
         return table;
 
     return permuteInner(table, indices);
@@ -244,6 +872,66 @@ std::shared_ptr<arrow::Table> permute(const std::shared_ptr<arrow::Table> &table
 
 std::shared_ptr<arrow::Table> sortTable(const std::shared_ptr<arrow::Table> &table, const std::vector<SortBy> &sortBy)
 {
+    if(sortBy.size() == 1 && isKnownSorted(*sortBy.front().column, sortBy.front().order, sortBy.front().nulls))
+        return table;
+
     auto permutation = sortPermutation(sortBy);
-    return permute(table, permutation);
+    auto sorted = permute(table, permutation);
+
+    // The first key column (if it is part of the table) is now known to be sorted.
+    const auto &key = sortBy.front();
+    auto columns = getColumns(*sorted);
+    for(int i = 0; i < table->num_columns(); i++)
+    {
+        if(table->column(i)->data() == key.column->data())
+        {
+            const auto &column = columns[i];
+            columns[i] = std::make_shared<arrow::Column>(sortedField(*column, key.order, key.nulls), column->data());
+        }
+    }
+    return tableWithColumns(*sorted, columns);
+}
+
+Permutation topPermutation(const std::vector<SortBy> &sortBy, int64_t count)
+{
+    if(sortBy.empty())
+        throw std::runtime_error("no column to sort by");
+    if(count < 0)
+        THROW("cannot select {} rows", count);
+
+    const auto length = sortBy.front().column->length();
+    for(auto &key : sortBy)
+        if(key.column->length() != length)
+            THROW("column to sort by `{}` has length {}, expected {}", key.column->name(), key.column->length(), length);
+
+    count = std::min(count, length);
+    if(sortBy.size() == 1 && isKnownSorted(*sortBy.front().column, sortBy.front().order, sortBy.front().nulls))
+        return iotaVector(count);
+
+    const auto rangeCount = parallelRangeCount(length, MinRowsPerSortRange);
+    std::vector<std::vector<TopCandidate>> candidatesPerRange(rangeCount);
+    parallelForRanges(length, rangeCount, [&] (int64_t rangeIndex, int64_t begin, int64_t end)
+    {
+        candidatesPerRange[rangeIndex] = selectTopCandidates(sortBy, begin, end, count);
+    });
+
+    // final merge: best of the best candidates from all ranges
+    std::vector<TopCandidate> candidates;
+    for(auto &rangeCandidates : candidatesPerRange)
+        std::move(rangeCandidates.begin(), rangeCandidates.end(), std::back_inserter(candidates));
+
+    std::sort(candidates.begin(), candidates.end(), [&] (const TopCandidate &lhs, const TopCandidate &rhs)
+    {
+        for(size_t key = 0; key < sortBy.size(); key++)
+            if(const auto result = compareKeyValues(lhs.keys[key], rhs.keys[key], sortBy[key].order))
+                return result < 0;
+        return lhs.row < rhs.row;
+    });
+    candidates.resize(count);
+    return transformToVector(candidates, [] (auto &&candidate) { return candidate.row; });
+}
+
+std::shared_ptr<arrow::Table> topRows(const std::shared_ptr<arrow::Table> &table, const std::vector<SortBy> &sortBy, int64_t count)
+{
+    return permute(table, topPermutation(sortBy, count));
 }
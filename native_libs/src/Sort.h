@@ -41,3 +41,7 @@ struct SortBy
 
 DFH_EXPORT std::shared_ptr<arrow::Table> sortTable(const std::shared_ptr<arrow::Table> &table, const std::vector<SortBy> &sortBy);
 
+// The first count rows of the table sorted by given keys (like sortTable followed by a slice),
+// selected without sorting the whole table.
+DFH_EXPORT Permutation topPermutation(const std::vector<SortBy> &sortBy, int64_t count);
+DFH_EXPORT std::shared_ptr<arrow::Table> topRows(const std::shared_ptr<arrow::Table> &table, const std::vector<SortBy> &sortBy, int64_t count);
@@ -0,0 +1,363 @@
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+#include <arrow/table.h>
+#include <arrow/util/key_value_metadata.h>
+
+#include "Core/ArrowUtilities.h"
+#include "Core/Grouping.h"
+#include "Core/Parallel.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+const std::string KeyPrefix = "dataframes."s;
+const std::string RowsKey = KeyPrefix + "rows";
+const std::string SortedKey = KeyPrefix + "sorted";
+const std::string NullsAtKey = KeyPrefix + "nulls_at";
+const std::string NullCountKey = KeyPrefix + "null_count";
+const std::string DistinctCountKey = KeyPrefix + "distinct_count";
+const std::string MinKey = KeyPrefix + "min";
+const std::string MaxKey = KeyPrefix + "max";
+
+bool isStatisticsKey(const std::string &key)
+{
+    return key.compare(0, KeyPrefix.size(), KeyPrefix) == 0;
+}
+
+std::string formatValue(const StatisticValue &value)
+{
+    return visit(overloaded{
+        [] (int64_t i) { return std::to_string(i); },
+        [] (double d) { return fmt::format("{:.17g}", d); }, // enough digits to read back the same double
+        [] (const std::string &s) { return s; }
+    }, value);
+}
+
+StatisticValue parseValue(const arrow::DataType &type, const std::string &text)
+{
+    switch(type.id())
+    {
+    case arrow::Type::DOUBLE:
+        return std::strtod(text.c_str(), nullptr);
+    case arrow::Type::STRING:
+        return text;
+    default:
+        return std::stoll(text);
+    }
+}
+
+StatisticValue statisticValue(int64_t value) { return value; }
+StatisticValue statisticValue(double value) { return value; }
+StatisticValue statisticValue(std::string_view value) { return std::string(value); }
+
+bool containsNaN(const arrow::Column &column)
+{
+    if(column.type()->id() != arrow::Type::DOUBLE)
+        return false;
+
+    bool ret = false;
+    iterateOver<arrow::Type::DOUBLE>(column,
+        [&] (double value) { ret = ret || std::isnan(value); },
+        [] () {});
+    return ret;
+}
+
+template<arrow::Type::type id>
+ColumnStatistics computeStatistics(const arrow::Column &column)
+{
+    using Value = std::conditional_t<id == arrow::Type::STRING, std::string_view,
+                  std::conditional_t<id == arrow::Type::DOUBLE, double, int64_t>>;
+
+    const auto N = column.length();
+    int64_t row = 0;
+    int64_t nullCount = 0;
+    int64_t firstValidRow = -1;
+    int64_t lastValidRow = -1;
+    bool ascending = true;
+    bool descending = true;
+    bool hasNaN = false;
+    std::optional<Value> previous, min, max;
+    DistinctCounter distinct;
+
+    iterateOver<id>(column,
+        [&] (auto &&observed)
+        {
+            const Value value = toStorage(observed);
+            if constexpr(id == arrow::Type::STRING)
+                distinct.add(hashKey(value));
+            else if constexpr(id == arrow::Type::DOUBLE)
+                distinct.add(hashKey(normalizedKeyBits(value)));
+            else
+                distinct.add(hashKey(static_cast<uint64_t>(value)));
+
+            if(firstValidRow < 0)
+                firstValidRow = row;
+            lastValidRow = row++;
+
+            if constexpr(id == arrow::Type::DOUBLE)
+            {
+                if(std::isnan(value))
+                {
+                    hasNaN = true;
+                    return;
+                }
+            }
+
+            if(previous)
+            {
+                ascending = ascending && !(value < *previous);
+                descending = descending && !(*previous < value);
+            }
+            previous = value;
+
+            if(!min || value < *min)
+                min = value;
+            if(!max || *max < value)
+                max = value;
+        },
+        [&] ()
+        {
+            ++nullCount;
+            ++row;
+        });
+
+    ColumnStatistics ret;
+    ret.rows = N;
+    ret.nullCount = nullCount;
+    ret.distinctCount = std::clamp<int64_t>(distinct.estimate(), N > nullCount, N - nullCount);
+    if(min)
+    {
+        ret.min = statisticValue(*min);
+        ret.max = statisticValue(*max);
+    }
+
+    // Values are sorted only if nulls are all on one side of them.
+    const bool nullsBefore = firstValidRow == nullCount;
+    const bool nullsAfter = lastValidRow == N - 1 - nullCount;
+    if(!hasNaN && (nullCount == 0 || nullCount == N || nullsBefore || nullsAfter))
+    {
+        ret.ascending = ascending;
+        ret.descending = descending;
+        if(nullCount != 0 && nullCount != N)
+            ret.nullsAt = nullsBefore ? NullPosition::Before : NullPosition::After;
+    }
+    return ret;
+}
+
+std::shared_ptr<arrow::Field> replaceStatistics(const std::shared_ptr<arrow::Field> &field, std::vector<std::string> keys, std::vector<std::string> values)
+{
+    // other metadata goes first, unchanged
+    std::vector<std::string> newKeys, newValues;
+    if(const auto metadata = field->metadata())
+    {
+        for(int64_t i = 0; i < metadata->size(); i++)
+        {
+            if(isStatisticsKey(metadata->key(i)))
+                continue;
+            newKeys.push_back(metadata->key(i));
+            newValues.push_back(metadata->value(i));
+        }
+    }
+    newKeys.insert(newKeys.end(), keys.begin(), keys.end());
+    newValues.insert(newValues.end(), values.begin(), values.end());
+
+    auto newMetadata = newKeys.empty() ? nullptr : std::make_shared<arrow::KeyValueMetadata>(newKeys, newValues);
+    return arrow::field(field->name(), field->type(), field->nullable(), newMetadata);
+}
+
+}
+
+bool ColumnStatistics::isSorted(SortOrder order, NullPosition nulls) const
+{
+    const bool valuesInOrder = order == SortOrder::Ascending ? ascending : descending;
+    return valuesInOrder && (!nullsAt || *nullsAt == nulls);
+}
+
+std::optional<ColumnStatistics> readStatistics(const arrow::Column &column)
+{
+    const auto metadata = column.field()->metadata();
+    if(!metadata)
+        return std::nullopt;
+
+    std::unordered_map<std::string, std::string> entries;
+    for(int64_t i = 0; i < metadata->size(); i++)
+        if(isStatisticsKey(metadata->key(i)))
+            entries[metadata->key(i)] = metadata->value(i);
+
+    const auto rows = entries.find(RowsKey);
+    if(rows == entries.end() || std::stoll(rows->second) != column.length())
+        return std::nullopt;
+
+    const auto find = [&] (const std::string &key) -> const std::string *
+    {
+        const auto itr = entries.find(key);
+        return itr != entries.end() ? &itr->second : nullptr;
+    };
+
+    ColumnStatistics ret;
+    ret.rows = column.length();
+    if(auto sorted = find(SortedKey))
+    {
+        ret.ascending = *sorted == "ascending" || *sorted == "constant";
+        ret.descending = *sorted == "descending" || *sorted == "constant";
+    }
+    if(auto nullsAt = find(NullsAtKey))
+        ret.nullsAt = *nullsAt == "before" ? NullPosition::Before : NullPosition::After;
+    if(auto nullCount = find(NullCountKey))
+        ret.nullCount = std::stoll(*nullCount);
+    if(auto distinctCount = find(DistinctCountKey))
+        ret.distinctCount = std::stoll(*distinctCount);
+    if(auto min = find(MinKey))
+        ret.min = parseValue(*column.type(), *min);
+    if(auto max = find(MaxKey))
+        ret.max = parseValue(*column.type(), *max);
+    return ret;
+}
+
+std::shared_ptr<arrow::Field> withStatistics(const std::shared_ptr<arrow::Field> &field, const ColumnStatistics &statistics)
+{
+    std::vector<std::string> keys, values;
+    const auto add = [&] (const std::string &key, std::string value)
+    {
+        keys.push_back(key);
+        values.push_back(std::move(value));
+    };
+
+    add(RowsKey, std::to_string(statistics.rows));
+    if(statistics.isSorted())
+    {
+        add(SortedKey, statistics.ascending && statistics.descending ? "constant"
+            : statistics.ascending ? "ascending" : "descending");
+        if(statistics.nullsAt)
+            add(NullsAtKey, *statistics.nullsAt == NullPosition::Before ? "before" : "after");
+    }
+    if(statistics.nullCount)
+        add(NullCountKey, std::to_string(*statistics.nullCount));
+    if(statistics.distinctCount)
+        add(DistinctCountKey, std::to_string(*statistics.distinctCount));
+    if(statistics.min)
+        add(MinKey, formatValue(*statistics.min));
+    if(statistics.max)
+        add(MaxKey, formatValue(*statistics.max));
+    return replaceStatistics(field, std::move(keys), std::move(values));
+}
+
+std::shared_ptr<arrow::Field> withoutStatistics(const std::shared_ptr<arrow::Field> &field)
+{
+    const auto metadata = field->metadata();
+    if(!metadata)
+        return field;
+
+    for(int64_t i = 0; i < metadata->size(); i++)
+        if(isStatisticsKey(metadata->key(i)))
+            return replaceStatistics(field, {}, {});
+    return field;
+}
+
+ColumnStatistics computeStatistics(const arrow::Column &column)
+{
+    return visitType(*column.type(), [&] (auto id)
+    {
+        return ::computeStatistics<id.value>(column);
+    });
+}
+
+std::shared_ptr<arrow::Column> annotateStatistics(const std::shared_ptr<arrow::Column> &column)
+{
+    const auto field = withStatistics(column->field(), computeStatistics(*column));
+    return std::make_shared<arrow::Column>(field, column->data());
+}
+
+std::shared_ptr<arrow::Table> annotateStatistics(const std::shared_ptr<arrow::Table> &table)
+{
+    auto columns = getColumns(*table);
+    parallelFor(columns.size(), [&] (int64_t i)
+    {
+        columns[i] = annotateStatistics(columns[i]);
+    });
+    return tableWithColumns(*table, columns);
+}
+
+bool isKnownSorted(const arrow::Column &column)
+{
+    const auto statistics = readStatistics(column);
+    return statistics && statistics->isSorted();
+}
+
+bool isKnownSorted(const arrow::Column &column, SortOrder order, NullPosition nulls)
+{
+    const auto statistics = readStatistics(column);
+    return statistics && statistics->isSorted(order, nulls);
+}
+
+std::shared_ptr<arrow::Field> subsetField(const arrow::Column &column, int64_t rowCount)
+{
+    const auto statistics = readStatistics(column);
+    if(!statistics)
+        return withoutStatistics(column.field());
+
+    // rows keep their relative order, but any of them could be gone
+    ColumnStatistics ret;
+    ret.rows = rowCount;
+    ret.ascending = statistics->ascending;
+    ret.descending = statistics->descending;
+    ret.nullsAt = statistics->nullsAt;
+    if(statistics->nullCount == 0)
+        ret.nullCount = 0;
+    return withStatistics(column.field(), ret);
+}
+
+std::shared_ptr<arrow::Field> gatheredField(const arrow::Column &column, const std::vector<int64_t> &indices)
+{
+    const auto rowCount = (int64_t)indices.size();
+    if(std::is_sorted(indices.begin(), indices.end()))
+    {
+        // all rows, in their order (distinct sorted indices of length rows must be 0..length-1)
+        const bool distinct = std::adjacent_find(indices.begin(), indices.end()) == indices.end();
+        if(distinct && rowCount == column.length())
+            return column.field();
+        // rows might be repeated, but they stay in order (repeated ones adjacent)
+        return subsetField(column, rowCount);
+    }
+
+    auto statistics = readStatistics(column);
+    if(!statistics || rowCount != column.length())
+        return withoutStatistics(column.field());
+
+    // values are the same only if every row is taken exactly once
+    std::vector<uint8_t> taken(rowCount);
+    for(auto index : indices)
+    {
+        if(index < 0 || index >= rowCount || taken[index])
+            return withoutStatistics(column.field());
+        taken[index] = 1;
+    }
+
+    // the same values, in different order
+    statistics->ascending = statistics->descending = false;
+    statistics->nullsAt = std::nullopt;
+    return withStatistics(column.field(), *statistics);
+}
+
+std::shared_ptr<arrow::Field> sortedField(const arrow::Column &column, SortOrder order, NullPosition nulls)
+{
+    auto statistics = readStatistics(column).value_or(ColumnStatistics{});
+    // NaNs are placed at one end of sorted doubles, but they compare with nothing, so such
+    // values are not sorted for operations trusting the flags (columns sorted before had none)
+    const bool sortable = statistics.isSorted() || !containsNaN(column);
+    statistics.rows = column.length();
+    statistics.ascending = sortable && order == SortOrder::Ascending;
+    statistics.descending = sortable && order == SortOrder::Descending;
+    const auto nullCount = column.null_count();
+    statistics.nullsAt = sortable && nullCount != 0 && nullCount != column.length()
+        ? std::optional<NullPosition>(nulls)
+        : std::nullopt;
+    return withStatistics(column.field(), statistics);
+}
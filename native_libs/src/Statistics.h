@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "variant.h"
+#include "optional.h"
+#include "Core/Common.h"
+#include "Sort.h"
+
+namespace arrow
+{
+    class Column;
+    class Field;
+    class Table;
+}
+
+// Statistics of column's values are persisted in its field metadata (under "dataframes.*" keys),
+// so operations can consult them without touching the data. Statistics describe the column length
+// they were computed for and are ignored for columns of any other length.
+
+// Min / max value. Timestamps are stored as tick counts.
+using StatisticValue = variant<int64_t, double, std::string>;
+
+struct DFH_EXPORT ColumnStatistics
+{
+    int64_t rows = 0;
+
+    // Non-null values are in ascending / descending order (both flags are set when all are equal).
+    // Doubles with NaN are never considered sorted.
+    bool ascending = false;
+    bool descending = false;
+    // For sorted columns: where the nulls are. Not set when nulls don't restrict the order
+    // (there are none or all values are null).
+    std::optional<NullPosition> nullsAt;
+
+    std::optional<int64_t> nullCount;
+    std::optional<int64_t> distinctCount; // estimated, see computeStatistics
+    std::optional<StatisticValue> min; // NaNs are skipped
+    std::optional<StatisticValue> max;
+
+    bool isSorted() const { return ascending || descending; }
+    bool isSorted(SortOrder order, NullPosition nulls) const;
+};
+
+// Statistics stored in column's field, nullopt if there are none valid for the column.
+DFH_EXPORT std::optional<ColumnStatistics> readStatistics(const arrow::Column &column);
+
+// Field with statistics set (replacing any previous ones, other metadata is kept).
+DFH_EXPORT std::shared_ptr<arrow::Field> withStatistics(const std::shared_ptr<arrow::Field> &field, const ColumnStatistics &statistics);
+DFH_EXPORT std::shared_ptr<arrow::Field> withoutStatistics(const std::shared_ptr<arrow::Field> &field);
+
+// Scans the column once. Distinct count is a HyperLogLog estimate (within a few percent).
+DFH_EXPORT ColumnStatistics computeStatistics(const arrow::Column &column);
+DFH_EXPORT std::shared_ptr<arrow::Column> annotateStatistics(const std::shared_ptr<arrow::Column> &column);
+DFH_EXPORT std::shared_ptr<arrow::Table> annotateStatistics(const std::shared_ptr<arrow::Table> &table);
+
+// Whether statistics say that the column is sorted (in any order), so equal values are adjacent.
+DFH_EXPORT bool isKnownSorted(const arrow::Column &column);
+DFH_EXPORT bool isKnownSorted(const arrow::Column &column, SortOrder order, NullPosition nulls);
+
+// Fields for columns derived from the given one, keeping the statistics that still hold:
+// * subset: some rows dropped, others kept in order (filter, slice) -- only the order is retained;
+// * gathered: rows at given indices (possibly repeated) -- order is retained if indices are
+//   non-decreasing, value statistics only if every row was taken exactly once;
+// * sorted: the column after sorting by it (not flagged as sorted if it has NaNs).
+DFH_EXPORT std::shared_ptr<arrow::Field> subsetField(const arrow::Column &column, int64_t rowCount);
+DFH_EXPORT std::shared_ptr<arrow::Field> gatheredField(const arrow::Column &column, const std::vector<int64_t> &indices);
+DFH_EXPORT std::shared_ptr<arrow::Field> sortedField(const arrow::Column &column, SortOrder order, NullPosition nulls);
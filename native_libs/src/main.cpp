@@ -14,6 +14,7 @@
 #include "Analysis.h"
 #include "Processing.h"
 #include "Sort.h"
+#include "Statistics.h"
 #include "LifetimeManager.h"
 #include "ValueHolder.h"
 #include "IO/csv.h"
@@ -21,6 +22,7 @@
 #include "IO/IO.h"
 #include "IO/JSON.h"
 #include "IO/XLSX.h"
+#include "LQuery/Plan.h"
 
 #include <arrow/array.h>
 #include <arrow/buffer.h>
@@ -147,6 +149,20 @@ namespace
             ret.push_back(vals[i]);
         return ret;
     }
+    std::vector<std::string> stringsFromC(const char **vals, int32_t size)
+    {
+        return transformToVector(vectorFromC(vals, size), [] (const char *s) { return std::string(s); });
+    }
+    std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> aggregationsFromC(int32_t aggregatedColumnsCount, arrow::Column **aggregatedColumns, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn)
+    {
+        std::vector<std::pair<std::shared_ptr<arrow::Column>, std::vector<AggregateFunction>>> ret;
+        for(int i = 0; i < aggregatedColumnsCount; ++i)
+        {
+            auto colManaged = LifetimeManager::instance().accessOwned(aggregatedColumns[i]);
+            ret.emplace_back(colManaged, vectorFromC(aggregatesPerColumn[i], aggregateCountPerColumn[i]));
+        }
+        return ret;
+    }
 }
 
 extern "C"
@@ -803,6 +819,15 @@ extern "C"
             return LifetimeManager::instance().addOwnership(ret);
         };
     }
+    DFH_EXPORT arrow::Table *columnTopValues(arrow::Column *column, int64_t count, const char **outError) noexcept
+    {
+        LOG("@{}, count={}", (void*)column, count);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = countValues(*column, count);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
     DFH_EXPORT arrow::Column *columnMin(arrow::Column *column, const char **outError) noexcept
     {
         LOG("@{}", (void*)column);
@@ -875,6 +900,24 @@ extern "C"
             return LifetimeManager::instance().addOwnership(ret);
         };
     }
+    DFH_EXPORT arrow::Column *columnQuantiles(arrow::Column *column, int32_t qsCount, const double *qs, const char **outError) noexcept
+    {
+        LOG("@{}, count={}", (void*)column, qsCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = calculateQuantiles(*column, vectorFromC(qs, qsCount));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT arrow::Column *columnApproximateQuantile(arrow::Column *column, double q, double compression, const char **outError) noexcept
+    {
+        LOG("@{}, q={}, compression={}", (void*)column, q, compression);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = calculateQuantile(*column, q, compression);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
     DFH_EXPORT arrow::Column *columnInterpolateNa(arrow::Column *table, const char **outError) noexcept
     {
         LOG("@{}", (void*)table);
@@ -904,6 +947,15 @@ extern "C"
             return autoCorrelation(columnManaged, lag);
         };
     }
+    DFH_EXPORT arrow::Column *columnAutoCorrelations(arrow::Column *column, int64_t maxLag, const char **outError) noexcept
+    {
+        LOG("@{}, maxLag={}", (void*)column, maxLag);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = autoCorrelations(*column, maxLag);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
 }
 
 // SCHEMA
@@ -1190,6 +1242,16 @@ extern "C"
         };
     }
 
+    DFH_EXPORT arrow::Table *tableDescribe(arrow::Table *table, int32_t qsCount, const double *qs, const char **outError) noexcept
+    {
+        LOG("@{}, count={}", (void*)table, qsCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = describeTable(*table, vectorFromC(qs, qsCount));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+
     DFH_EXPORT arrow::Table *tableCorrelationMatrix(arrow::Table *table, const char **outError) noexcept
     {
         LOG("@{} value={}", (void*)table);
@@ -1230,6 +1292,36 @@ extern "C"
             return LifetimeManager::instance().addOwnership(ret);
         };
     }
+    DFH_EXPORT arrow::Table *tableTopRowsByColumns(arrow::Table *table, int64_t count, int32_t columnCount, arrow::Column **columns, SortOrder *columnOrders, NullPosition *nullPositions, const char **outError) noexcept
+    {
+        LOG("@{} count={}", (void*)table, count);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            std::vector<SortBy> sortBy;
+            for(int i = 0; i < columnCount; i++)
+            {
+                const auto columnManaged = LifetimeManager::instance().accessOwned(columns[i]);
+                if(columnManaged->length() != table->num_rows())
+                    throw std::runtime_error("Column to sort by named '" + columnManaged->name() + "' has different row count than the table!");
+
+                sortBy.emplace_back(columnManaged, columnOrders[i], nullPositions[i]);
+            }
+
+            auto tableManaged = LifetimeManager::instance().accessOwned(table);
+            auto ret = topRows(tableManaged, sortBy, count);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT arrow::Table *tableWithStatistics(arrow::Table *table, const char **outError) noexcept
+    {
+        LOG("@{}", (void*)table);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto tableManaged = LifetimeManager::instance().accessOwned(table);
+            auto ret = annotateStatistics(tableManaged);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
     DFH_EXPORT arrow::Table *tableInterpolateNa(arrow::Table *table, const char **outError) noexcept
     {
         LOG("@{}", (void*)table);
@@ -1241,13 +1333,14 @@ extern "C"
         };
     }
 
-    DFH_EXPORT arrow::Table *tableAggregateBy(arrow::Column *keyColumn, int32_t aggregatedColumnsCount, arrow::Column **aggregatedColumns, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn, const char **outError) noexcept
+    DFH_EXPORT arrow::Table *tableAggregateBy(int32_t keyColumnsCount, arrow::Column **keyColumns, int32_t aggregatedColumnsCount, arrow::Column **aggregatedColumns, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn, const char **outError) noexcept
     {
-        LOG("index={}", keyColumn->name());
+        LOG("keyColumnsCount={}, aggregatedColumnsCount={}", keyColumnsCount, aggregatedColumnsCount);
         return TRANSLATE_EXCEPTION(outError)
         {
-            auto keyColumnManaged = LifetimeManager::instance().accessOwned(keyColumn);
-            
+            auto keyColumnsManaged = transformToVector(vectorFromC(keyColumns, keyColumnsCount), [] (auto *column)
+                { return LifetimeManager::instance().accessOwned(column); });
+
             auto columnsToAggregate = vectorFromC(aggregatedColumns, aggregatedColumnsCount);
             auto columnsToAggregateManaged = transformToVector(columnsToAggregate, [] (auto *column) 
                 { return LifetimeManager::instance().accessOwned(column); });
@@ -1261,7 +1354,7 @@ extern "C"
                 aggregationMap.emplace_back(colManaged, aggregates);
             }
 
-            auto ret = abominableGroupAggregate(keyColumnManaged, aggregationMap);
+            auto ret = abominableGroupAggregate(keyColumnsManaged, aggregationMap);
             return LifetimeManager::instance().addOwnership(ret);
         };
     }
@@ -1292,6 +1385,30 @@ extern "C"
         };
     }
 
+    // minPeriods < 0 means default (windowSize)
+    DFH_EXPORT arrow::Table *tableRollingRows(int64_t windowSize, bool center, int64_t minPeriods, int32_t aggregatedColumnsCount, arrow::Column **aggregatedColumns, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn, const char **outError) noexcept
+    {
+        LOG("windowSize={}, center={}, minPeriods={}", windowSize, center, minPeriods);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto aggregationMap = aggregationsFromC(aggregatedColumnsCount, aggregatedColumns, aggregateCountPerColumn, aggregatesPerColumn);
+            auto minPeriodsOpt = minPeriods >= 0 ? std::optional<int64_t>(minPeriods) : std::nullopt;
+            auto ret = rollingRows(aggregationMap, windowSize, center, minPeriodsOpt);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+
+    DFH_EXPORT arrow::Table *tableExpanding(int64_t minPeriods, int32_t aggregatedColumnsCount, arrow::Column **aggregatedColumns, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn, const char **outError) noexcept
+    {
+        LOG("minPeriods={}", minPeriods);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto aggregationMap = aggregationsFromC(aggregatedColumnsCount, aggregatedColumns, aggregateCountPerColumn, aggregatesPerColumn);
+            auto ret = expanding(aggregationMap, minPeriods);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+
     DFH_EXPORT arrow::Table *tableUngroupSplittingOn(arrow::Table *table, arrow::Column *stringColumn, const char *separator, const char **outError) noexcept
     {
         LOG("@{}, column={}, separator={}", (void*)table, (void*)stringColumn, separator);
@@ -1303,6 +1420,87 @@ extern "C"
     }
 }
 
+// QUERY PLAN
+extern "C"
+{
+    DFH_EXPORT plan::QueryPlan *planFromTable(arrow::Table *table, const char **outError) noexcept
+    {
+        LOG("@{}", (void*)table);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto tableManaged = LifetimeManager::instance().accessOwned(table);
+            auto ret = std::make_shared<plan::QueryPlan>(tableManaged);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT plan::QueryPlan *planFilter(plan::QueryPlan *queryPlan, const char *lqueryJSON, const char **outError) noexcept
+    {
+        LOG("@{} {}", (void*)queryPlan, lqueryJSON);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = std::make_shared<plan::QueryPlan>(queryPlan->then(plan::Filter{ lqueryJSON }));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT plan::QueryPlan *planDropNA(plan::QueryPlan *queryPlan, int32_t columnCount, const char **columnNames, const char **outError) noexcept
+    {
+        LOG("@{} column count={}", (void*)queryPlan, columnCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = std::make_shared<plan::QueryPlan>(queryPlan->then(plan::DropNA{ stringsFromC(columnNames, columnCount) }));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT plan::QueryPlan *planSelect(plan::QueryPlan *queryPlan, int32_t columnCount, const char **columnNames, const char **outError) noexcept
+    {
+        LOG("@{} column count={}", (void*)queryPlan, columnCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = std::make_shared<plan::QueryPlan>(queryPlan->then(plan::Select{ stringsFromC(columnNames, columnCount) }));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT plan::QueryPlan *planSortedByColumns(plan::QueryPlan *queryPlan, int32_t columnCount, const char **columnNames, SortOrder *columnOrders, NullPosition *nullPositions, const char **outError) noexcept
+    {
+        LOG("@{} column count={}", (void*)queryPlan, columnCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            plan::Sort sort;
+            for(int i = 0; i < columnCount; i++)
+                sort.keys.push_back(plan::SortKey{ columnNames[i], columnOrders[i], nullPositions[i] });
+
+            auto ret = std::make_shared<plan::QueryPlan>(queryPlan->then(sort));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT plan::QueryPlan *planAggregateBy(plan::QueryPlan *queryPlan, int32_t keyColumnsCount, const char **keyColumnNames, int32_t aggregatedColumnsCount, const char **aggregatedColumnNames, int8_t *aggregateCountPerColumn, AggregateFunction **aggregatesPerColumn, const char **outError) noexcept
+    {
+        LOG("@{} keyColumnsCount={}, aggregatedColumnsCount={}", (void*)queryPlan, keyColumnsCount, aggregatedColumnsCount);
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            plan::Aggregate aggregate;
+            aggregate.keys = stringsFromC(keyColumnNames, keyColumnsCount);
+            for(int aggregatedColumnIndex = 0; aggregatedColumnIndex < aggregatedColumnsCount; ++aggregatedColumnIndex)
+            {
+                auto aggregates = vectorFromC(aggregatesPerColumn[aggregatedColumnIndex], aggregateCountPerColumn[aggregatedColumnIndex]);
+                aggregate.aggregations.emplace_back(aggregatedColumnNames[aggregatedColumnIndex], aggregates);
+            }
+
+            auto ret = std::make_shared<plan::QueryPlan>(queryPlan->then(aggregate));
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+    DFH_EXPORT arrow::Table *planExecute(plan::QueryPlan *queryPlan, const char **outError) noexcept
+    {
+        LOG("@{} step count={}", (void*)queryPlan, queryPlan->steps.size());
+        return TRANSLATE_EXCEPTION(outError)
+        {
+            auto ret = plan::execute(*queryPlan);
+            return LifetimeManager::instance().addOwnership(ret);
+        };
+    }
+}
+
 arrow::Table *readTableFromCSVFileContentsHelper(std::string data, const char **columnNames, int32_t columnNamesPolicy, int8_t *columnTypes, int8_t *columnIsNullableTypes, int32_t columnTypeInfoCount)
 {
     CsvReadOptions opts;
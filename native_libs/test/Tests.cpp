@@ -10,6 +10,7 @@
 #include <fstream>
 #include <numeric>
 #include <random>
+#include <unordered_map>
 
 #include <date/date.h>
 
@@ -18,10 +19,14 @@
 #include "IO/Feather.h"
 #include "Core/ArrowUtilities.h"
 #include "Core/Benchmark.h"
+#include "Core/Grouping.h"
+#include "Core/QuantileSketch.h"
 #include "optional.h"
 #include "Processing.h"
 #include "Sort.h"
+#include "Statistics.h"
 #include "Analysis.h"
+#include "LQuery/Plan.h"
 
 #include "Fixture.h"
 #include "Core/Utils.h"
@@ -129,6 +134,188 @@ BOOST_AUTO_TEST_CASE(SortSimple)
         { 3, 4, 8, 7, 5, 1, 2, 6, 0 });
 }
 
+BOOST_AUTO_TEST_CASE(SortThreeKeysWithWideRange)
+{
+    // the middle key spans whole int64 range, so its null flag can't share the code with values
+    const auto lowest = std::numeric_limits<int64_t>::min();
+    const auto highest = std::numeric_limits<int64_t>::max();
+    std::vector<std::optional<std::string>> strings{ "b"s, "a"s, "b"s, std::nullopt, "a"s, "b"s, "a"s };
+    std::vector<std::optional<int64_t>> ints{ highest, lowest, std::nullopt, 5, highest, lowest, std::nullopt };
+    std::vector<double> doubles{ 1.0, -0.0, 3.0, 2.0, -1.5, 0.0, 7.0 };
+    auto iota = iotaVector(ints.size());
+    auto table = tableFromVectors(strings, ints, doubles, iota);
+
+    const auto sorted = sortTable(table,
+        { { table->column(0), SortOrder::Descending, NullPosition::After }
+        , { table->column(1), SortOrder::Ascending,  NullPosition::After }
+        , { table->column(2), SortOrder::Descending, NullPosition::Before } });
+    const auto order = toVector<int64_t>(*sorted->column(3));
+    const std::vector<int64_t> expectedOrder{ 5, 0, 2, 1, 4, 6, 3 };
+    BOOST_CHECK_EQUAL_RANGES(order, expectedOrder);
+}
+
+BOOST_AUTO_TEST_CASE(SortRadixNumericKeys)
+{
+    // enough rows for radix sort to be used
+    std::mt19937 generator{ 42 };
+    std::uniform_int_distribution<int64_t> ints(-1000, 1000);
+    std::normal_distribution<double> doubles;
+    std::vector<std::optional<int64_t>> intValues;
+    std::vector<std::optional<double>> doubleValues;
+    for(int i = 0; i < 5000; i++)
+    {
+        intValues.push_back(i % 7 ? std::optional<int64_t>(ints(generator)) : std::nullopt);
+        doubleValues.push_back(i % 11 ? std::optional<double>(doubles(generator)) : std::nullopt);
+    }
+    auto iota = iotaVector(intValues.size());
+    auto table = tableFromVectors(intValues, doubleValues, iota);
+
+    auto expectedOrder = iota;
+    std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&] (int64_t lhs, int64_t rhs)
+    {
+        // ints descending with nulls after, then doubles ascending with nulls before
+        if(intValues[lhs] != intValues[rhs])
+            return intValues[lhs] && (!intValues[rhs] || *intValues[lhs] > *intValues[rhs]);
+        return doubleValues[lhs] < doubleValues[rhs];
+    });
+
+    const auto sorted = sortTable(table,
+        { { table->column(0), SortOrder::Descending, NullPosition::After }
+        , { table->column(1), SortOrder::Ascending,  NullPosition::Before } });
+    const auto order = toVector<int64_t>(*sorted->column(2));
+    BOOST_CHECK_EQUAL_RANGES(order, expectedOrder);
+}
+
+BOOST_AUTO_TEST_CASE(SortLargeTable)
+{
+    // large enough to be sorted and permuted in ranges by several threads
+    const int64_t rowCount = 500'000;
+    std::mt19937 generator{ 7 };
+    std::uniform_int_distribution<int64_t> keys(0, 999);
+    std::vector<int64_t> keyValues;
+    std::vector<std::string> labels;
+    for(int64_t i = 0; i < rowCount; i++)
+    {
+        keyValues.push_back(keys(generator));
+        labels.push_back(std::to_string(i));
+    }
+    auto iota = iotaVector(rowCount);
+    auto table = tableFromVectors(keyValues, labels, iota);
+
+    auto expectedOrder = iota;
+    std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&] (int64_t lhs, int64_t rhs)
+    {
+        return keyValues[lhs] > keyValues[rhs];
+    });
+
+    const auto sorted = sortTable(table, { { table->column(0), SortOrder::Descending } });
+    const auto [sortedKeys, sortedLabels, order] = toVectors<int64_t, std::string, int64_t>(*sorted);
+    BOOST_CHECK_EQUAL_RANGES(order, expectedOrder);
+    for(int64_t i = 0; i < rowCount; i += 9973)
+    {
+        BOOST_CHECK_EQUAL(sortedKeys[i], keyValues[order[i]]);
+        BOOST_CHECK_EQUAL(sortedLabels[i], labels[order[i]]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SortStringsByPrefix)
+{
+    // long strings share the 8-byte prefix, short ones are decided by it alone
+    std::mt19937 generator{ 11 };
+    std::uniform_int_distribution<int> letters('a', 'd');
+    std::vector<std::optional<std::string>> strings;
+    for(int i = 0; i < 3000; i++)
+    {
+        std::string value(i % 5, 'x');
+        for(auto &c : value)
+            c = letters(generator);
+        if(i % 3 == 0)
+            value = "commonprefix" + value;
+        strings.push_back(i % 23 ? std::optional<std::string>(value) : std::nullopt);
+    }
+    auto iota = iotaVector(strings.size());
+    auto table = tableFromVectors(strings, iota);
+
+    auto expectedOrder = iota;
+    std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&] (int64_t lhs, int64_t rhs)
+    {
+        // descending, nulls first
+        if(!strings[lhs] || !strings[rhs])
+            return !strings[lhs] && strings[rhs];
+        return *strings[lhs] > *strings[rhs];
+    });
+
+    const auto sorted = sortTable(table, { { table->column(0), SortOrder::Descending, NullPosition::Before } });
+    const auto order = toVector<int64_t>(*sorted->column(1));
+    BOOST_CHECK_EQUAL_RANGES(order, expectedOrder);
+}
+
+BOOST_AUTO_TEST_CASE(PermuteChunkedColumns)
+{
+    std::vector<std::optional<std::string>> strings;
+    std::vector<std::optional<double>> doubles;
+    for(int i = 0; i < 200; i++)
+    {
+        strings.push_back(i % 7 ? std::optional<std::string>(std::string(i % 5, 'a' + i % 26)) : std::nullopt);
+        doubles.push_back(i % 9 ? std::optional<double>(i * 0.25) : std::nullopt);
+    }
+
+    // sliced chunks, so offsets of values and bitmaps are not zero
+    const auto chunked = [] (std::shared_ptr<arrow::Array> array)
+    {
+        const auto chunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ array->Slice(0, 70), array->Slice(70, 0), array->Slice(70, 61), array->Slice(131) });
+        return std::make_shared<arrow::Column>(arrow::field("values", array->type()), chunks);
+    };
+    const auto stringColumn = chunked(toArray(strings));
+    const auto doubleColumn = chunked(toArray(doubles));
+
+    std::mt19937 generator{ 5 };
+    std::uniform_int_distribution<int64_t> rows(0, 199);
+    Permutation indices;
+    for(int i = 0; i < 150; i++)
+        indices.push_back(rows(generator));
+
+    const auto expectedStrings = transformToVector(indices, [&] (int64_t row) { return strings[row]; });
+    const auto expectedDoubles = transformToVector(indices, [&] (int64_t row) { return doubles[row]; });
+    const auto permutedStrings = toVector<std::optional<std::string>>(*permuteToArray(stringColumn, indices));
+    const auto permutedDoubles = toVector<std::optional<double>>(*permuteToArray(doubleColumn, indices));
+    BOOST_CHECK_EQUAL_RANGES(permutedStrings, expectedStrings);
+    BOOST_CHECK_EQUAL_RANGES(permutedDoubles, expectedDoubles);
+}
+
+BOOST_AUTO_TEST_CASE(TopRowsMatchSortedPrefix)
+{
+    std::mt19937 generator{ 3 };
+    std::uniform_int_distribution<int64_t> smallInts(0, 20);
+    std::vector<std::optional<int64_t>> ints;
+    std::vector<std::optional<double>> doubles;
+    std::vector<std::optional<std::string>> strings;
+    for(int i = 0; i < 20'000; i++)
+    {
+        const auto value = smallInts(generator);
+        ints.push_back(i % 13 ? std::optional<int64_t>(value) : std::nullopt);
+        doubles.push_back(i % 17 ? std::optional<double>(value * 0.5 - 3) : std::nullopt);
+        strings.push_back(i % 19 ? std::optional<std::string>(std::to_string(value * 7)) : std::nullopt);
+    }
+    auto iota = iotaVector(ints.size());
+    auto table = tableFromVectors(ints, doubles, strings, iota);
+
+    const auto testTop = [&] (std::vector<SortBy> sortBy, int64_t count)
+    {
+        const auto sortedOrder = toVector<int64_t>(*sortTable(table, sortBy)->column(3));
+        const std::vector<int64_t> expectedOrder(sortedOrder.begin(), sortedOrder.begin() + std::min<int64_t>(count, sortedOrder.size()));
+        const auto order = toVector<int64_t>(*topRows(table, sortBy, count)->column(3));
+        BOOST_CHECK_EQUAL_RANGES(order, expectedOrder);
+    };
+
+    testTop({ { table->column(0), SortOrder::Descending, NullPosition::After } }, 100);
+    testTop({ { table->column(0), SortOrder::Ascending, NullPosition::Before } }, 2000);
+    testTop({ { table->column(1), SortOrder::Descending, NullPosition::Before }, { table->column(2), SortOrder::Ascending, NullPosition::After } }, 500);
+    testTop({ { table->column(2), SortOrder::Descending, NullPosition::After }, { table->column(0), SortOrder::Descending, NullPosition::After } }, 50);
+    testTop({ { table->column(0), SortOrder::Ascending, NullPosition::After } }, 0);
+    testTop({ { table->column(1), SortOrder::Ascending, NullPosition::After } }, 30'000);
+}
+
 void testFieldParser(std::string input, std::string expectedContent, int expectedPosition)
 {
 	CsvParser parser{input};
@@ -952,6 +1139,72 @@ BOOST_AUTO_TEST_CASE(FillingNAStrings)
 	BOOST_CHECK_EQUAL_COLLECTIONS(valuesFilled.begin(), valuesFilled.end(), expectedFilled.begin(), expectedFilled.end());
 }
 
+BOOST_AUTO_TEST_CASE(FillingNASlicedChunks)
+{
+    std::vector<std::optional<int64_t>> ints;
+    std::vector<std::optional<std::string>> strings;
+    std::vector<int64_t> expectedInts;
+    std::vector<std::string> expectedStrings;
+    for(int i = 0; i < 150; i++)
+    {
+        const bool isNull = i % 5 == 0 || (i >= 60 && i < 80);
+        ints.push_back(isNull ? std::nullopt : std::optional<int64_t>(i));
+        strings.push_back(isNull ? std::nullopt : std::optional<std::string>(std::to_string(i)));
+        expectedInts.push_back(isNull ? -1 : i);
+        expectedStrings.push_back(isNull ? "none"s : std::to_string(i));
+    }
+
+    const auto intsArray = toArray(ints);
+    const auto stringsArray = toArray(strings);
+    const auto intsChunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ intsArray->Slice(0, 37), intsArray->Slice(37) });
+    const auto stringsChunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ stringsArray->Slice(0, 61), stringsArray->Slice(61) });
+
+    const auto filledInts = toVector<int64_t>(*fillNA(intsChunks, int64_t(-1)));
+    const auto filledStrings = toVector<std::string>(*fillNA(stringsChunks, "none"s));
+    BOOST_CHECK_EQUAL_RANGES(filledInts, expectedInts);
+    BOOST_CHECK_EQUAL_RANGES(filledStrings, expectedStrings);
+
+    // array owned only by the caller gets its values patched in place
+    auto ownedArray = toArray(ints);
+    const auto filledOwned = fillNA(std::move(ownedArray), int64_t(-1));
+    BOOST_CHECK_EQUAL(filledOwned->null_count(), 0);
+    const auto filledOwnedValues = toVector<int64_t>(*filledOwned);
+    BOOST_CHECK_EQUAL_RANGES(filledOwnedValues, expectedInts);
+}
+
+BOOST_AUTO_TEST_CASE(DropNAMisalignedChunks)
+{
+    std::vector<std::optional<int64_t>> ints;
+    std::vector<std::optional<double>> doubles;
+    std::vector<int64_t> expectedInts;
+    std::vector<double> expectedDoubles;
+    for(int i = 0; i < 200; i++)
+    {
+        ints.push_back(i % 7 == 0 ? std::nullopt : std::optional<int64_t>(i));
+        doubles.push_back(i % 11 == 3 ? std::nullopt : std::optional<double>(i * 0.5));
+        if(ints.back() && doubles.back())
+        {
+            expectedInts.push_back(*ints.back());
+            expectedDoubles.push_back(*doubles.back());
+        }
+    }
+
+    // chunks of both columns start at different, not 64-aligned rows
+    const auto intsArray = toArray(ints);
+    const auto doublesArray = toArray(doubles);
+    const auto intsChunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ intsArray->Slice(0, 70), intsArray->Slice(70, 3), intsArray->Slice(73) });
+    const auto doublesChunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ doublesArray->Slice(0, 13), doublesArray->Slice(13, 100), doublesArray->Slice(113) });
+    const auto table = tableFromArrays({ intsChunks, doublesChunks });
+
+    const auto [droppedInts, droppedDoubles] = toVectors<int64_t, double>(*dropNA(table));
+    BOOST_CHECK_EQUAL_RANGES(droppedInts, expectedInts);
+    BOOST_CHECK_EQUAL_RANGES(droppedDoubles, expectedDoubles);
+
+    // only the first column is considered
+    const auto droppedByInts = dropNA(table, {0});
+    BOOST_CHECK_EQUAL(droppedByInts->num_rows(), 200 - 29);
+}
+
 BOOST_AUTO_TEST_CASE(Statistics)
 {
 	std::vector<std::optional<int64_t>> ints{1, 1, std::nullopt, 3, std::nullopt, 11};
@@ -987,6 +1240,67 @@ BOOST_AUTO_TEST_CASE(Statistics)
 // 	calculateCorrelation(*toColumn(a), *toColumn(b));
 }
 
+BOOST_AUTO_TEST_CASE(StatisticsOfChunkedColumnsWithNulls)
+{
+    // values far from zero and chunks not aligned to validity words
+    std::mt19937 generator{ 7 };
+    std::normal_distribution<> distribution{ -1e9, 1.0 };
+    std::vector<std::optional<double>> doubles(1000);
+    std::vector<std::optional<int64_t>> ints(1000);
+    for(int i = 0; i < 1000; i++)
+    {
+        if(i % 7 == 3 || (i >= 200 && i < 328))
+            continue;
+        doubles[i] = distribution(generator);
+        ints[i] = int64_t(*doubles[i] * 10);
+    }
+
+    const auto chunked = [] (const auto &values)
+    {
+        const auto array = toArray(values);
+        const auto chunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ array->Slice(0, 61), array->Slice(61, 0), array->Slice(61, 500), array->Slice(561) });
+        return toColumn(chunks);
+    };
+    const auto scalar = [] (const std::shared_ptr<arrow::Column> &column) { return toVector<double>(*column).front(); };
+
+    const auto check = [&] (const auto &values)
+    {
+        long double sum = 0;
+        double min = std::numeric_limits<double>::max(), max = std::numeric_limits<double>::lowest();
+        int64_t count = 0;
+        for(auto value : values)
+        {
+            if(value)
+            {
+                sum += *value;
+                min = std::min<double>(min, *value);
+                max = std::max<double>(max, *value);
+                ++count;
+            }
+        }
+        const auto mean = sum / count;
+        long double squares = 0;
+        for(auto value : values)
+            if(value)
+                squares += (*value - mean) * (*value - mean);
+
+        const auto column = chunked(values);
+        BOOST_CHECK_CLOSE(scalar(calculateSum(*column)), (double)sum, 1e-12);
+        BOOST_CHECK_CLOSE(scalar(calculateMean(*column)), (double)mean, 1e-12);
+        BOOST_CHECK_CLOSE(scalar(calculateVariance(*column)), (double)(squares / count), 1e-6);
+        BOOST_CHECK_CLOSE(scalar(calculateStandardDeviation(*column)), (double)std::sqrt(squares / count), 1e-6);
+        BOOST_CHECK_EQUAL(scalar(calculateMin(*column)), min);
+        BOOST_CHECK_EQUAL(scalar(calculateMax(*column)), max);
+    };
+    check(doubles);
+    check(ints);
+
+    // NaN is skipped by min / max
+    const auto withNaN = toColumn(std::vector<double>{ -3.0, NAN, -1.0, -2.0 });
+    BOOST_CHECK_EQUAL(scalar(calculateMin(*withNaN)), -3.0);
+    BOOST_CHECK_EQUAL(scalar(calculateMax(*withNaN)), -1.0);
+}
+
 struct RsiTestingFixture
 {
     auto rsi(const std::vector<std::optional<double>> &vector)
@@ -1032,6 +1346,20 @@ BOOST_AUTO_TEST_CASE(InterpolateNA)
     BOOST_CHECK_THROW(testInterpolation<std::string>({"foo"s, std::nullopt, "bar"s}, {}), std::exception);
 }
 
+BOOST_AUTO_TEST_CASE(InterpolateNAAcrossChunks)
+{
+    std::vector<std::optional<double>> values{ std::nullopt, 0, std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt, 6, 7, std::nullopt };
+    std::vector<double> expected{ 0, 0, 1, 2, 3, 4, 5, 6, 7, 7 };
+
+    // the middle gap spans three chunks, one of them holding only nulls
+    const auto array = toArray(values);
+    const auto chunks = std::make_shared<arrow::ChunkedArray>(arrow::ArrayVector{ array->Slice(0, 3), array->Slice(3, 2), array->Slice(5, 3), array->Slice(8) });
+    const auto column = std::make_shared<arrow::Column>(arrow::field("values", array->type()), chunks);
+
+    const auto interpolated = toVector<double>(*interpolateNA(column));
+    BOOST_CHECK_EQUAL_RANGES(interpolated, expected);
+}
+
 BOOST_AUTO_TEST_CASE(MakeNullsArray)
 {
     auto nullInts = makeNullsArray(arrow::TypeTraits<arrow::Int64Type>::type_singleton(), 5);
@@ -1042,6 +1370,12 @@ BOOST_AUTO_TEST_CASE(MakeNullsArray)
     auto nullIntsV = toVector<std::optional<int64_t>>(*nullInts);
     std::vector<std::optional<int64_t>> nullIntsVExpected(5);
     BOOST_CHECK_EQUAL_RANGES(nullIntsV, nullIntsVExpected);
+
+    // too large for the shared zeroes, gets its own buffer
+    auto manyNulls = makeNullsArray(arrow::TypeTraits<arrow::DoubleType>::type_singleton(), 1 << 20);
+    BOOST_CHECK_EQUAL(manyNulls->null_count(), 1 << 20);
+    const auto values = static_cast<const arrow::DoubleArray &>(*manyNulls).raw_values();
+    BOOST_CHECK(std::all_of(values, values + (1 << 20), [] (double value) { return value == 0; }));
 }
 
 BOOST_AUTO_TEST_CASE(CsvWithUtf8Path)
@@ -1086,6 +1420,13 @@ BOOST_AUTO_TEST_CASE(ColumnShift)
     test(-2, { 3, std::nullopt, std::nullopt });
     test(-3, { std::nullopt, std::nullopt, std::nullopt });
     test(-4, { std::nullopt, std::nullopt, std::nullopt });
+
+    // nulls chunk must be valid for var-sized types too
+    std::vector<std::string> strings{ "a", "bb", "ccc" };
+    auto stringsCol = toColumn(strings);
+    auto shiftedStrings = toVector<std::optional<std::string>>(*shift(stringsCol, -2));
+    std::vector<std::optional<std::string>> expectedStrings{ "ccc"s, std::nullopt, std::nullopt };
+    BOOST_CHECK_EQUAL_RANGES(shiftedStrings, expectedStrings);
 }
 
 BOOST_AUTO_TEST_CASE(AutoCorrelation)
@@ -1105,6 +1446,159 @@ BOOST_AUTO_TEST_CASE(AutoCorrelation)
     // Note: values above are calculated by pandas.
 }
 
+BOOST_AUTO_TEST_CASE(AutoCorrelationsOfAllLags)
+{
+    // both direct and FFT computation compared with a naive one
+    std::mt19937 generator{ 5 };
+    std::normal_distribution<> distribution;
+    std::vector<std::optional<double>> values(3000);
+    for(int i = 0; i < 3000; i++)
+        if(i % 13 != 4)
+            values[i] = 100 + std::sin(i * 0.3) + distribution(generator);
+
+    double sum = 0;
+    int count = 0;
+    for(auto value : values)
+    {
+        if(value)
+        {
+            sum += *value;
+            ++count;
+        }
+    }
+    const auto deviations = transformToVector(values, [&] (std::optional<double> value) { return value ? *value - sum / count : 0.0; });
+    const auto laggedProducts = [&] (int lag)
+    {
+        double ret = 0;
+        for(int i = 0; i + lag < 3000; i++)
+            ret += deviations[i] * deviations[i + lag];
+        return ret;
+    };
+
+    const auto column = toColumn(values);
+    for(int maxLag : { 10, 500 })
+    {
+        const auto acf = toVector<double>(*autoCorrelations(*column, maxLag));
+        BOOST_REQUIRE_EQUAL(acf.size(), size_t(maxLag + 1));
+        BOOST_CHECK_EQUAL(acf[0], 1.0);
+        for(int lag = 1; lag <= maxLag; lag++)
+            BOOST_CHECK_SMALL(acf[lag] - laggedProducts(lag) / laggedProducts(0), 1e-12);
+    }
+
+    // lags past the end have no pairs
+    const auto shortColumn = toColumn(std::vector<double>{ 1, 2, 4 });
+    const auto shortAcf = toVector<double>(*autoCorrelations(*shortColumn, 4));
+    BOOST_REQUIRE_EQUAL(shortAcf.size(), 5u);
+    BOOST_CHECK_EQUAL(shortAcf[3], 0.0);
+    BOOST_CHECK_EQUAL(shortAcf[4], 0.0);
+
+    const auto constant = toVector<double>(*autoCorrelations(*toColumn(std::vector<int64_t>{ 3, 3, 3 }), 1));
+    BOOST_CHECK(std::isnan(constant[0]) && std::isnan(constant[1]));
+    BOOST_CHECK_THROW(autoCorrelations(*column, -1), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(CorrelationMatrixPairwiseComplete)
+{
+    // large offset would ruin correlation computed from raw sums
+    const int64_t N = 40000;
+    std::mt19937 generator{42};
+    std::normal_distribution<> distribution;
+    std::vector<std::vector<std::optional<double>>> values(3, std::vector<std::optional<double>>(N));
+    for(int64_t i = 0; i < N; i++)
+    {
+        const auto common = distribution(generator);
+        values[0][i] = 1e9 + common;
+        if(i % 5)
+            values[1][i] = 1e9 - common + distribution(generator);
+        if(i % 7)
+            values[2][i] = 2 * common + 0.1 * distribution(generator);
+    }
+
+    const auto expectedCorrelation = [&] (int x, int y)
+    {
+        std::vector<std::pair<double, double>> pairs;
+        for(int64_t i = 0; i < N; i++)
+            if(values[x][i] && values[y][i])
+                pairs.emplace_back(*values[x][i], *values[y][i]);
+
+        double meanX = 0, meanY = 0;
+        for(auto [vx, vy] : pairs)
+        {
+            meanX += vx / pairs.size();
+            meanY += vy / pairs.size();
+        }
+        double sxy = 0, sxx = 0, syy = 0;
+        for(auto [vx, vy] : pairs)
+        {
+            sxy += (vx - meanX) * (vy - meanY);
+            sxx += (vx - meanX) * (vx - meanX);
+            syy += (vy - meanY) * (vy - meanY);
+        }
+        return sxy / std::sqrt(sxx * syy);
+    };
+
+    const auto table = tableFromColumns({ toColumn(values[0], "a"), toColumn(values[1], "b"), toColumn(values[2], "c") });
+    const auto matrix = calculateCorrelationMatrix(*table);
+    for(int i = 0; i < 3; i++)
+    {
+        const auto correlations = toVector<double>(*matrix->column(i));
+        for(int j = 0; j < 3; j++)
+            BOOST_CHECK_CLOSE(correlations[j], i == j ? 1.0 : expectedCorrelation(i, j), 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CorrelationMatrixManyColumns)
+{
+    // wide enough that a tile holds only part of the rows
+    const int64_t N = 3000;
+    const int columnCount = 300;
+    std::mt19937 generator{7};
+    std::normal_distribution<> distribution;
+    std::vector<double> common(N);
+    for(auto &value : common)
+        value = distribution(generator);
+
+    std::vector<std::vector<std::optional<double>>> values(columnCount, std::vector<std::optional<double>>(N));
+    std::vector<std::shared_ptr<arrow::Column>> columns;
+    for(int c = 0; c < columnCount; c++)
+    {
+        for(int64_t i = 0; i < N; i++)
+            if(c % 2 == 0 || (i + c) % 11)
+                values[c][i] = (c % 3 - 1.5) * common[i] + distribution(generator);
+        columns.push_back(toColumn(values[c], "c" + std::to_string(c)));
+    }
+
+    const auto expectedCorrelation = [&] (int x, int y)
+    {
+        double n = 0, sumX = 0, sumY = 0;
+        for(int64_t i = 0; i < N; i++)
+            if(values[x][i] && values[y][i])
+            {
+                n++;
+                sumX += *values[x][i];
+                sumY += *values[y][i];
+            }
+        double sxy = 0, sxx = 0, syy = 0;
+        for(int64_t i = 0; i < N; i++)
+            if(values[x][i] && values[y][i])
+            {
+                const auto dx = *values[x][i] - sumX / n;
+                const auto dy = *values[y][i] - sumY / n;
+                sxy += dx * dy;
+                sxx += dx * dx;
+                syy += dy * dy;
+            }
+        return sxy / std::sqrt(sxx * syy);
+    };
+
+    const auto matrix = calculateCorrelationMatrix(*tableFromColumns(columns));
+    for(auto [i, j] : { std::pair{ 0, 1 }, std::pair{ 1, 3 }, std::pair{ 5, 298 }, std::pair{ 150, 151 }, std::pair{ 297, 299 } })
+    {
+        const auto correlations = toVector<double>(*matrix->column(i));
+        BOOST_CHECK_CLOSE(correlations[j], expectedCorrelation(i, j), 1e-6);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TableFromColumnsWithVaryingLengths)
 {
     std::vector<int64_t> ints = { 1, 2, 3 };
@@ -1150,6 +1644,268 @@ BOOST_AUTO_TEST_CASE(Rolling, *boost::unit_test_framework::disabled())
     BOOST_CHECK_EQUAL_RANGES(get<1>(sumsPerWindowV), expectedSumsPerWindow);
 }
 
+BOOST_AUTO_TEST_CASE(CountValues)
+{
+    // small range of ints is counted directly, wide one and other types are hashed
+    const auto countsOf = [] (const std::shared_ptr<arrow::Column> &column, std::optional<int64_t> topN = std::nullopt)
+    {
+        const auto table = countValues(*column, topN);
+        const auto values = toVector<std::optional<int64_t>>(*table->column(0));
+        const auto counts = toVector<int64_t>(*table->column(1));
+        std::map<std::optional<int64_t>, int64_t> ret;
+        for(size_t i = 0; i < values.size(); i++)
+            ret[values[i]] = counts[i];
+        return ret;
+    };
+
+    const std::vector<std::optional<int64_t>> narrow{ 5, 3, std::nullopt, 5, -2, 5, std::nullopt, 3 };
+    const std::map<std::optional<int64_t>, int64_t> expectedNarrow{ {std::nullopt, 2}, {-2, 1}, {3, 2}, {5, 3} };
+    const auto narrowCounts = countsOf(toColumn(narrow));
+    BOOST_CHECK(narrowCounts == expectedNarrow);
+
+    const std::vector<std::optional<int64_t>> wide{ 1'000'000'000'000, std::nullopt, -7, 1'000'000'000'000 };
+    const std::map<std::optional<int64_t>, int64_t> expectedWide{ {std::nullopt, 1}, {-7, 1}, {1'000'000'000'000, 2} };
+    const auto wideCounts = countsOf(toColumn(wide));
+    BOOST_CHECK(wideCounts == expectedWide);
+
+    // most frequent first, null counts as a value
+    const auto top = countValues(*toColumn(narrow), 2);
+    const auto topValues = toVector<std::optional<int64_t>>(*top->column(0));
+    const auto topCounts = toVector<int64_t>(*top->column(1));
+    const std::vector<std::optional<int64_t>> expectedTopValues{ 5, std::nullopt };
+    const std::vector<int64_t> expectedTopCounts{ 3, 2 };
+    BOOST_CHECK_EQUAL_RANGES(topValues, expectedTopValues);
+    BOOST_CHECK_EQUAL_RANGES(topCounts, expectedTopCounts);
+    BOOST_CHECK_THROW(countValues(*toColumn(narrow), -1), std::exception);
+
+    const auto strings = countValues(*toColumn(std::vector<std::string>{ "b", "a", "b", "c", "b", "a" }), 1);
+    const auto topString = toVector<std::string>(*strings->column(0));
+    const auto topStringCount = toVector<int64_t>(*strings->column(1));
+    const std::vector<std::string> expectedTopString{ "b" };
+    const std::vector<int64_t> expectedTopStringCount{ 3 };
+    BOOST_CHECK_EQUAL_RANGES(topString, expectedTopString);
+    BOOST_CHECK_EQUAL_RANGES(topStringCount, expectedTopStringCount);
+
+    // all NaNs are the same value
+    const auto doubles = countValues(*toColumn(std::vector<double>{ NAN, 1.5, NAN, -0.0, 0.0 }));
+    BOOST_CHECK_EQUAL(doubles->num_rows(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(MultipleQuantiles)
+{
+    const auto column = toColumn(std::vector<std::optional<int64_t>>{ 7, 1, std::nullopt, 4, 9, 2, 2, 8, 5 }, "value");
+    const std::vector<double> qs{ 0.99, 0.0, 0.25, 0.5, 0.01, 1.0, 0.75 };
+    const auto quantiles = toVector<double>(*calculateQuantiles(*column, qs));
+    BOOST_REQUIRE_EQUAL(quantiles.size(), qs.size());
+    for(size_t i = 0; i < qs.size(); i++)
+        BOOST_CHECK_EQUAL(quantiles[i], toVector<double>(*calculateQuantile(*column, qs[i])).front());
+}
+
+BOOST_AUTO_TEST_CASE(DescribeTable)
+{
+    const auto ints = toColumn(std::vector<std::optional<int64_t>>{ 7, 1, std::nullopt, 4, 9, 2, 2, 8, 5 }, "ints");
+    const auto doubles = toColumn(std::vector<std::optional<double>>{ 0.5, NAN, std::nullopt, std::nullopt, -1.5 }, "doubles");
+    const auto strings = toColumn(std::vector<std::string>{ "a", "b", "a" }, "strings");
+    // shorter columns are padded with nulls to 9 rows
+    const auto table = tableFromColumns({ ints, doubles, strings });
+    const std::vector<double> qs{ 0.25, 0.5 };
+    const auto description = describeTable(*table, qs);
+    BOOST_REQUIRE_EQUAL(description->num_columns(), 4);
+    BOOST_REQUIRE_EQUAL(description->num_rows(), 9);
+
+    const auto statistics = toVector<std::string>(*description->column(0));
+    const std::vector<std::string> expectedStatistics{ "count", "null count", "distinct", "min", "max", "mean", "std dev", "quantile 0.250000", "quantile 0.500000" };
+    BOOST_CHECK_EQUAL_RANGES(statistics, expectedStatistics);
+
+    const auto intsDescription = toVector<std::optional<double>>(*description->column(1));
+    const auto scalar = [] (const std::shared_ptr<arrow::Column> &column) { return toVector<double>(*column).front(); };
+    BOOST_CHECK_EQUAL(*intsDescription[0], 8);
+    BOOST_CHECK_EQUAL(*intsDescription[1], 1);
+    BOOST_CHECK_EQUAL(*intsDescription[2], 7);
+    BOOST_CHECK_EQUAL(*intsDescription[3], 1);
+    BOOST_CHECK_EQUAL(*intsDescription[4], 9);
+    BOOST_CHECK_CLOSE(*intsDescription[5], scalar(calculateMean(*ints)), 1e-9);
+    BOOST_CHECK_CLOSE(*intsDescription[6], scalar(calculateStandardDeviation(*ints)), 1e-9);
+    BOOST_CHECK_EQUAL(*intsDescription[7], scalar(calculateQuantile(*ints, 0.25)));
+    BOOST_CHECK_EQUAL(*intsDescription[8], scalar(calculateMedian(*ints)));
+
+    // NaN is counted as a value, but skipped by numeric statistics
+    const auto doublesDescription = toVector<std::optional<double>>(*description->column(2));
+    const std::vector<std::optional<double>> expectedDoubles{ 3.0, 6.0, 3.0, -1.5, 0.5, -0.5, 1.0, -1.5, -0.5 };
+    BOOST_CHECK_EQUAL_RANGES(doublesDescription, expectedDoubles);
+
+    const auto stringsDescription = toVector<std::optional<double>>(*description->column(3));
+    const std::vector<std::optional<double>> expectedStrings{ 3.0, 6.0, 2.0, std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt };
+    BOOST_CHECK_EQUAL_RANGES(stringsDescription, expectedStrings);
+}
+
+BOOST_AUTO_TEST_CASE(ApproximateQuantiles)
+{
+    // permutation of 0..N-1, so quantile q is about q * N
+    const int64_t N = 100003;
+    std::vector<double> values(N);
+    std::vector<int64_t> keys(N);
+    for(int64_t i = 0; i < N; i++)
+    {
+        values[i] = double(i * 7919 % N);
+        keys[i] = i % 3;
+    }
+    const auto column = toColumn(values, "value");
+    const auto tolerance = 0.01 * N;
+
+    for(auto q : { 0.01, 0.5, 0.99 })
+    {
+        const auto approximate = toVector<double>(*calculateQuantile(*column, q, 100.0)).front();
+        BOOST_CHECK_SMALL(approximate - q * N, tolerance);
+    }
+    const auto exact = toVector<double>(*calculateQuantile(*column, 0.5, std::nullopt)).front();
+    BOOST_CHECK_EQUAL(exact, toVector<double>(*calculateMedian(*column)).front());
+
+    const auto aggregated = abominableGroupAggregate(toColumn(keys, "key"), { { column, { AggregateFunction::Median, AggregateFunction::ApproximateMedian } } });
+    const auto exactMedians = toVector<double>(*aggregated->column(1));
+    const auto approximateMedians = toVector<double>(*aggregated->column(2));
+    for(size_t i = 0; i < exactMedians.size(); i++)
+        BOOST_CHECK_SMALL(approximateMedians[i] - exactMedians[i], tolerance);
+
+    const auto expandingMedians = toVector<double>(*expanding({ { column, { AggregateFunction::ApproximateMedian } } })->column(0));
+    BOOST_CHECK_EQUAL(expandingMedians.front(), values.front());
+    BOOST_CHECK_SMALL(expandingMedians.back() - 0.5 * N, tolerance);
+}
+
+BOOST_AUTO_TEST_CASE(ApproximateQuantilesMergedSketches)
+{
+    // permutation of 0..N-1 split between sketches, some values fall into the unmerged buffers
+    const int64_t N = 1 << 18;
+    const auto tolerance = 0.01 * N;
+    QuantileSketch first, second, empty;
+    std::vector<double> values(N);
+    std::vector<int64_t> keys(N);
+    for(int64_t i = 0; i < N; i++)
+    {
+        values[i] = double(i * 7919 % N);
+        keys[i] = i % 3;
+        (i % 5 ? first : second).add(values[i]);
+    }
+    first.merge(empty);
+    empty.merge(second);
+    first.merge(empty);
+    BOOST_CHECK_EQUAL(first.count(), N);
+    for(auto q : { 0.01, 0.25, 0.5, 0.99 })
+        BOOST_CHECK_SMALL(first.quantile(q) - q * N, tolerance);
+
+    // enough rows for partial sketches aggregated in parallel and merged
+    const auto column = toColumn(values, "value");
+    const auto aggregated = abominableGroupAggregate(toColumn(keys, "key"), { { column, { AggregateFunction::Median, AggregateFunction::ApproximateMedian } } });
+    const auto exactMedians = toVector<double>(*aggregated->column(1));
+    const auto approximateMedians = toVector<double>(*aggregated->column(2));
+    BOOST_REQUIRE_EQUAL(approximateMedians.size(), 3u);
+    for(size_t i = 0; i < exactMedians.size(); i++)
+        BOOST_CHECK_SMALL(approximateMedians[i] - exactMedians[i], tolerance);
+}
+
+BOOST_AUTO_TEST_CASE(RollingIntervalAggregates)
+{
+    const date::sys_days day = 2013_y / jan / 01;
+    std::vector<Timestamp> ts;
+    for(int i = 0; i < 6; i++)
+        ts.push_back(day + 9h + std::chrono::seconds(i));
+
+    // windows are (t - 3s, t]: rows {0}, {0,1}, {0,1,2}, {1,2,3}, {2,3,4}, {3,4,5}
+    const auto tsCol = toColumn(ts);
+    const auto numCol = toColumn(std::vector<std::optional<double>>{ 1.0, 5.0, std::nullopt, 3.0, -2.0, 4.0 });
+    const std::vector<AggregateFunction> functions{ AggregateFunction::Minimum, AggregateFunction::Maximum, AggregateFunction::Mean,
+        AggregateFunction::Median, AggregateFunction::Sum, AggregateFunction::Length, AggregateFunction::First, AggregateFunction::Last };
+    const auto result = rollingInterval(tsCol, 3s, { { numCol, functions } });
+    BOOST_REQUIRE_EQUAL(result->num_columns(), 1 + (int)functions.size());
+
+    const std::vector<std::vector<double>> expected
+    {
+        { 1, 1, 1, 3, -2, -2 },
+        { 1, 5, 5, 5, 3, 4 },
+        { 1, 3, 3, 4, 0.5, 5.0 / 3 },
+        { 1, 3, 3, 4, 0.5, 3 },
+        { 1, 6, 6, 8, 1, 5 },
+        { 1, 2, 3, 3, 3, 3 },
+        { 1, 1, 1, 5, 3, 3 },
+        { 1, 5, 5, 3, -2, 4 },
+    };
+    for(size_t i = 0; i < functions.size(); i++)
+    {
+        const auto values = toVector<double>(*result->column(i + 1));
+        BOOST_CHECK_EQUAL_RANGES(values, expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RollingRowsAndExpanding)
+{
+    const auto numCol = toColumn(std::vector<std::optional<double>>{ 1.0, 5.0, std::nullopt, 3.0, -2.0, 4.0 }, "a");
+    const auto none = std::optional<double>{};
+
+    {
+        // full windows required by default
+        const auto result = rollingRows({ { numCol, { AggregateFunction::Sum } } }, 3);
+        const auto sums = toVector<std::optional<double>>(*result->column(0));
+        const std::vector<std::optional<double>> expected{ none, none, none, none, none, 5.0 };
+        BOOST_CHECK_EQUAL_RANGES(sums, expected);
+    }
+    {
+        const auto result = rollingRows({ { numCol, { AggregateFunction::Sum } } }, 3, false, 2);
+        const auto sums = toVector<std::optional<double>>(*result->column(0));
+        const std::vector<std::optional<double>> expected{ none, 6.0, 6.0, 8.0, 1.0, 5.0 };
+        BOOST_CHECK_EQUAL_RANGES(sums, expected);
+    }
+    {
+        const auto result = rollingRows({ { numCol, { AggregateFunction::Maximum } } }, 3, true, 1);
+        const auto maxima = toVector<double>(*result->column(0));
+        const std::vector<double> expected{ 5, 5, 5, 3, 4, 4 };
+        BOOST_CHECK_EQUAL_RANGES(maxima, expected);
+    }
+    {
+        const auto result = expanding({ { numCol, { AggregateFunction::Sum, AggregateFunction::Mean } } });
+        BOOST_REQUIRE_EQUAL(result->num_columns(), 2);
+        const auto sums = toVector<double>(*result->column(0));
+        const auto means = toVector<double>(*result->column(1));
+        const std::vector<double> expectedSums{ 1, 6, 6, 9, 7, 11 };
+        const std::vector<double> expectedMeans{ 1, 3, 3, 3, 1.75, 11.0 / 5 };
+        BOOST_CHECK_EQUAL_RANGES(sums, expectedSums);
+        BOOST_CHECK_EQUAL_RANGES(means, expectedMeans);
+    }
+
+    BOOST_CHECK_THROW(rollingRows({ { numCol, { AggregateFunction::Sum } } }, 0), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(RollingStdDevAndRSI)
+{
+    const auto inf = std::numeric_limits<double>::infinity();
+    {
+        // infinity poisons windows it is in, a run of equal values after unequal ones gives exact 0
+        const auto numCol = toColumn(std::vector<double>{ 0.1, 0.7, inf, 0.5, 0.3, 0.3, 0.3, 0.3, 0.9 }, "a");
+        const auto result = rollingRows({ { numCol, { AggregateFunction::StdDev } } }, 3, false, 1);
+        const auto deviations = toVector<std::optional<double>>(*result->column(0));
+        BOOST_REQUIRE_EQUAL(deviations.size(), 9u);
+        BOOST_CHECK(!deviations[0]); // needs two values
+        BOOST_CHECK_CLOSE(*deviations[1], 0.3, 1e-9);
+        for(int row = 2; row < 5; row++)
+            BOOST_CHECK(deviations[row] && std::isnan(*deviations[row]));
+        BOOST_CHECK_CLOSE(*deviations[5], std::sqrt(2.0) / 15, 1e-9);
+        BOOST_CHECK_EQUAL(*deviations[6], 0.0);
+        BOOST_CHECK_EQUAL(*deviations[7], 0.0);
+        BOOST_CHECK_CLOSE(*deviations[8], 0.2 * std::sqrt(2.0), 1e-9);
+    }
+    {
+        const auto numCol = toColumn(std::vector<double>{ 1, -2, inf, -1, -1, 2, 0.5 }, "a");
+        const auto result = rollingRows({ { numCol, { AggregateFunction::RSI } } }, 3, false, 1);
+        const auto rsi = toVector<double>(*result->column(0));
+        BOOST_REQUIRE_EQUAL(rsi.size(), 7u);
+        BOOST_CHECK_CLOSE(rsi[0], 100.0, 1e-9);
+        BOOST_CHECK_CLOSE(rsi[1], 100.0 / 3, 1e-9);
+        for(int row = 2; row < 5; row++)
+            BOOST_CHECK(std::isnan(rsi[row]));
+        BOOST_CHECK_CLOSE(rsi[5], 50.0, 1e-9);
+        BOOST_CHECK_CLOSE(rsi[6], 250.0 / 3.5, 1e-9);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(SliceBoundsChecking)
 {
     auto column = toColumn<int64_t>({ 1,2,3,4,5 });
@@ -1213,6 +1969,323 @@ BOOST_AUTO_TEST_CASE(RelaxedAggregationRules)
     }
 }
 
+BOOST_AUTO_TEST_CASE(GroupByKeys)
+{
+    const auto keys = toColumn(std::vector<std::optional<int64_t>>{ 5, std::nullopt, 3, 5, 5, std::nullopt, 8 }, "key");
+    const auto values = toColumn(std::vector<int64_t>{ 0, 1, 2, 3, 4, 5, 6 }, "value");
+    const auto grouped = groupBy(tableFromColumns({ keys, values }), keys);
+    BOOST_REQUIRE_EQUAL(grouped->num_columns(), 2);
+
+    // null group comes first, then groups in order of their first row, rows keep their order
+    const auto groupKeys = toVector<std::optional<int64_t>>(*grouped->column(0));
+    const auto groupValues = toVector<std::vector<int64_t>>(*grouped->column(1));
+    const std::vector<std::optional<int64_t>> expectedKeys{ std::nullopt, 5, 3, 8 };
+    const std::vector<std::vector<int64_t>> expectedValues{ { 1, 5 }, { 0, 3, 4 }, { 2 }, { 6 } };
+    BOOST_CHECK_EQUAL_RANGES(groupKeys, expectedKeys);
+    BOOST_CHECK_EQUAL_RANGES(groupValues, expectedValues);
+}
+
+BOOST_AUTO_TEST_CASE(AggregateByCompositeKey)
+{
+    const auto stores = toColumn(std::vector<std::optional<std::string>>{ "a"s, "b"s, "a"s, std::nullopt, "a"s, std::nullopt }, "store");
+    const auto days = toColumn(std::vector<std::optional<int64_t>>{ 1, 1, 2, 1, 1, 1 }, "day");
+    const auto sales = toColumn(std::vector<double>{ 1, 2, 3, 4, 5, 6 }, "sales");
+
+    // null is a regular key value when grouping by several columns
+    const auto aggregated = abominableGroupAggregate({ stores, days }, { { sales, { AggregateFunction::Sum } } });
+    const auto [aggregatedStores, aggregatedDays, sums] = toVectors<std::optional<std::string>, int64_t, double>(*aggregated);
+    const std::vector<std::optional<std::string>> expectedStores{ "a"s, "b"s, "a"s, std::nullopt };
+    const std::vector<int64_t> expectedDays{ 1, 1, 2, 1 };
+    const std::vector<double> expectedSums{ 6, 2, 3, 10 };
+    BOOST_CHECK_EQUAL_RANGES(aggregatedStores, expectedStores);
+    BOOST_CHECK_EQUAL_RANGES(aggregatedDays, expectedDays);
+    BOOST_CHECK_EQUAL_RANGES(sums, expectedSums);
+
+    const auto grouped = groupBy(tableFromColumns({ stores, days, sales }), { stores, days });
+    BOOST_REQUIRE_EQUAL(grouped->num_columns(), 3);
+    const auto groupedSales = toVector<std::vector<double>>(*grouped->column(2));
+    const std::vector<std::vector<double>> expectedGroupedSales{ { 1, 5 }, { 2 }, { 3 }, { 4, 6 } };
+    BOOST_CHECK_EQUAL_RANGES(groupedSales, expectedGroupedSales);
+}
+
+BOOST_AUTO_TEST_CASE(AggregateFunctionsByGroup)
+{
+    const auto keys = toColumn(std::vector<int64_t>{ 1, 2, 1, 2, 3, 1, 3 }, "key");
+    const auto values = toColumn(std::vector<std::optional<double>>{ -1.0, 4.0, -3.0, std::nullopt, std::nullopt, -2.0, std::nullopt }, "value");
+    const std::vector<AggregateFunction> functions{ AggregateFunction::Minimum, AggregateFunction::Maximum, AggregateFunction::Mean,
+        AggregateFunction::Median, AggregateFunction::Sum, AggregateFunction::Length, AggregateFunction::First, AggregateFunction::Last };
+    const auto aggregated = abominableGroupAggregate(keys, { { values, functions } });
+    BOOST_REQUIRE_EQUAL(aggregated->num_columns(), 1 + (int)functions.size());
+
+    // groups without valid values get nulls, except for sum and length
+    const auto none = std::optional<double>{};
+    const std::vector<std::vector<std::optional<double>>> expected
+    {
+        { -3.0, 4.0, none },
+        { -1.0, 4.0, none },
+        { -2.0, 4.0, none },
+        { -2.0, 4.0, none },
+        { -6.0, 4.0, 0.0 },
+        { 3.0, 2.0, 2.0 },
+        { -1.0, 4.0, none },
+        { -2.0, 4.0, none },
+    };
+    for(size_t i = 0; i < functions.size(); i++)
+    {
+        const auto results = toVector<std::optional<double>>(*aggregated->column(i + 1));
+        BOOST_CHECK_EQUAL_RANGES(results, expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(GroupRowsPartitioned)
+{
+    // enough rows and groups for the radix-partitioned path
+    const int64_t N = 300'000;
+    std::mt19937 generator{ 11 };
+    std::uniform_int_distribution<uint64_t> keyDistribution(0, 150'000);
+    std::vector<uint64_t> keys(N);
+    std::vector<uint8_t> valid(N);
+    for(int64_t row = 0; row < N; row++)
+    {
+        keys[row] = keyDistribution(generator);
+        valid[row] = row % 97 != 50;
+    }
+
+    // reference: ids by the first appearance, nulls are group 0
+    std::unordered_map<uint64_t, int64_t> referenceIds;
+    std::vector<int64_t> referenceGroupIds(N);
+    std::vector<int64_t> referenceFirstRows{ 50 };
+    for(int64_t row = 0; row < N; row++)
+    {
+        if(!valid[row])
+            continue;
+        const auto [it, inserted] = referenceIds.emplace(keys[row], referenceFirstRows.size());
+        if(inserted)
+            referenceFirstRows.push_back(row);
+        referenceGroupIds[row] = it->second;
+    }
+    BOOST_REQUIRE(N >= detail::MinRowsToPartition);
+    BOOST_REQUIRE((int64_t)referenceIds.size() > detail::MaxUnpartitionedGroups);
+
+    const auto groups = groupRows(keys, valid);
+    BOOST_CHECK(groups.hasNulls);
+    BOOST_REQUIRE_EQUAL(groups.groupCount, (int64_t)referenceFirstRows.size());
+    BOOST_REQUIRE_EQUAL(groups.firstRows.size(), referenceFirstRows.size());
+
+    // ids may differ, but must map one to one, and first rows must be the first ones of groups
+    std::vector<int64_t> toReference(groups.groupCount, -1);
+    int64_t mismatches = 0;
+    for(int64_t row = 0; row < N; row++)
+    {
+        auto &mapped = toReference[groups.groupIds[row]];
+        if(mapped < 0)
+        {
+            mapped = referenceGroupIds[row];
+            mismatches += groups.firstRows[groups.groupIds[row]] != row;
+            mismatches += referenceFirstRows[mapped] != row;
+        }
+        mismatches += mapped != referenceGroupIds[row];
+    }
+    BOOST_CHECK_EQUAL(mismatches, 0);
+    BOOST_CHECK_EQUAL(groups.groupIds[50], 0);
+}
+
+BOOST_AUTO_TEST_CASE(AggregateLargeColumnByGroup)
+{
+    // enough rows for aggregating partial states in parallel
+    const int64_t N = 1 << 19;
+    const int64_t groupCount = 7;
+    std::vector<int64_t> keys(N);
+    std::vector<std::optional<double>> values(N);
+    for(int64_t i = 0; i < N; i++)
+    {
+        keys[i] = i % groupCount;
+        if(i % 11)
+            values[i] = double(i);
+    }
+
+    const auto aggregated = abominableGroupAggregate(toColumn(keys, "key"), { { toColumn(values, "value"),
+        { AggregateFunction::Sum, AggregateFunction::First, AggregateFunction::Last, AggregateFunction::Median, AggregateFunction::StdDev } } });
+    const auto sums = toVector<double>(*aggregated->column(1));
+    const auto firsts = toVector<double>(*aggregated->column(2));
+    const auto lasts = toVector<double>(*aggregated->column(3));
+    const auto medians = toVector<double>(*aggregated->column(4));
+    const auto stdDevs = toVector<double>(*aggregated->column(5));
+
+    // group sizes differ in parity, so both the middle value and the interpolated median are checked
+    int64_t evenGroups = 0;
+    for(int64_t group = 0; group < groupCount; group++)
+    {
+        std::vector<double> groupValues;
+        for(int64_t i = group; i < N; i += groupCount)
+            if(values[i])
+                groupValues.push_back(*values[i]);
+
+        const auto sum = std::accumulate(groupValues.begin(), groupValues.end(), 0.0);
+        const auto mean = sum / groupValues.size();
+        double m2 = 0;
+        for(auto value : groupValues)
+            m2 += (value - mean) * (value - mean);
+
+        BOOST_CHECK_EQUAL(sums[group], sum);
+        BOOST_CHECK_EQUAL(firsts[group], groupValues.front());
+        BOOST_CHECK_EQUAL(lasts[group], groupValues.back());
+        std::sort(groupValues.begin(), groupValues.end());
+        const auto middle = groupValues.size() / 2;
+        if(groupValues.size() % 2)
+            BOOST_CHECK_EQUAL(medians[group], groupValues[middle]);
+        else
+        {
+            ++evenGroups;
+            BOOST_CHECK_EQUAL(medians[group], (groupValues[middle - 1] + groupValues[middle]) / 2);
+        }
+        BOOST_CHECK_CLOSE(stdDevs[group], std::sqrt(m2 / groupValues.size()), 1e-9);
+    }
+    BOOST_CHECK(evenGroups > 0 && evenGroups < groupCount);
+}
+
+BOOST_AUTO_TEST_CASE(QueryPlanOptimizedExecution)
+{
+    const auto stores = toColumn(std::vector<std::optional<std::string>>{ "a"s, "b"s, "a"s, "c"s, "b"s, "a"s }, "store");
+    const auto sales = toColumn(std::vector<std::optional<int64_t>>{ 5, 3, std::nullopt, 1, 8, 2 }, "sales");
+    const auto notes = toColumn(std::vector<std::string>{ "x", "y", "z", "w", "v", "u" }, "notes");
+    const auto table = tableFromColumns({ stores, sales, notes });
+
+    // query: sales > 1
+    const auto jsonQuery = R"({"predicate": "gt", "arguments": [ {"column": "sales"}, 1 ]})";
+
+    const auto sorted = plan::QueryPlan(table)
+        .then(plan::Sort{ { plan::SortKey{ "sales", SortOrder::Descending } } })
+        .then(plan::Filter{ jsonQuery });
+
+    const auto optimizedSorted = plan::optimize(sorted);
+    BOOST_REQUIRE_EQUAL(optimizedSorted.steps.size(), 2);
+    BOOST_CHECK(holds_alternative<plan::Filter>(optimizedSorted.steps[0]));
+    BOOST_CHECK(holds_alternative<plan::Sort>(optimizedSorted.steps[1]));
+
+    const auto [sortedStores, sortedSales, sortedNotes] = toVectors<std::string, int64_t, std::string>(*plan::execute(sorted));
+    const std::vector<std::string> expectedSortedStores{ "b"s, "a"s, "b"s, "a"s };
+    const std::vector<int64_t> expectedSortedSales{ 8, 5, 3, 2 };
+    BOOST_CHECK_EQUAL_RANGES(sortedStores, expectedSortedStores);
+    BOOST_CHECK_EQUAL_RANGES(sortedSales, expectedSortedSales);
+
+    const auto aggregated = plan::QueryPlan(table)
+        .then(plan::Filter{ jsonQuery })
+        .then(plan::Aggregate{ { "store" }, { { "sales", { AggregateFunction::Sum } } } });
+    const auto aggregatedColumns = plan::outputColumns(aggregated);
+    const std::vector<std::string> expectedAggregatedColumns{ "store", "sales_sum" };
+    BOOST_CHECK_EQUAL_RANGES(aggregatedColumns, expectedAggregatedColumns);
+
+    // notes are never used, filter gets fused into aggregation
+    const auto optimizedAggregated = plan::optimize(aggregated);
+    BOOST_REQUIRE_EQUAL(optimizedAggregated.steps.size(), 2);
+    BOOST_CHECK(holds_alternative<plan::Select>(optimizedAggregated.steps[0]));
+    BOOST_CHECK(holds_alternative<plan::FilteredAggregate>(optimizedAggregated.steps[1]));
+
+    const auto [aggregatedStores, sums] = toVectors<std::string, double>(*plan::execute(aggregated));
+    const std::vector<std::string> expectedStores{ "a"s, "b"s };
+    const std::vector<double> expectedSums{ 7, 11 };
+    BOOST_CHECK_EQUAL_RANGES(aggregatedStores, expectedStores);
+    BOOST_CHECK_EQUAL_RANGES(sums, expectedSums);
+
+    BOOST_CHECK_THROW(plan::outputColumns(plan::QueryPlan(table).then(plan::Select{ { "missing" } })), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(ColumnStatisticsFastPaths)
+{
+    const auto values = toColumn(std::vector<std::optional<int64_t>>{ 5, 1, 4, std::nullopt, 1, 3 }, "values");
+    const auto labels = toColumn(std::vector<std::string>{ "a", "b", "c", "d", "e", "f" }, "labels");
+    const auto table = annotateStatistics(tableFromColumns({ values, labels }));
+
+    const auto statistics = readStatistics(*table->column(0));
+    BOOST_REQUIRE(statistics);
+    BOOST_CHECK(!statistics->isSorted());
+    BOOST_CHECK_EQUAL(statistics->nullCount.value(), 1);
+    BOOST_CHECK_EQUAL(statistics->distinctCount.value(), 4);
+    BOOST_CHECK_EQUAL(get<int64_t>(statistics->min.value()), 1);
+    BOOST_CHECK_EQUAL(get<int64_t>(statistics->max.value()), 5);
+    BOOST_CHECK(isKnownSorted(*table->column(1), SortOrder::Ascending, NullPosition::Before));
+
+    // sorting marks the key column, values statistics survive the permutation
+    const auto sorted = sortTable(table, { { table->column(0), SortOrder::Ascending, NullPosition::After } });
+    BOOST_CHECK(isKnownSorted(*sorted->column(0), SortOrder::Ascending, NullPosition::After));
+    BOOST_CHECK(!isKnownSorted(*sorted->column(1)));
+    BOOST_CHECK_EQUAL(readStatistics(*sorted->column(0))->nullCount.value(), 1);
+    BOOST_CHECK(sortTable(sorted, { { sorted->column(0), SortOrder::Ascending, NullPosition::After } }) == sorted);
+
+    // dropping rows keeps the order, so the range can be found by binary search
+    const auto nonNull = dropNA(sorted);
+    BOOST_CHECK(isKnownSorted(*nonNull->column(0)));
+    const auto filtered = filter(nonNull, R"({"boolean": "and", "arguments": [
+        {"predicate": "gt", "arguments": [ {"column": "values"}, 1 ]},
+        {"predicate": "gt", "arguments": [ 5, {"column": "values"} ]} ]})");
+    const auto [filteredValues, filteredLabels] = toVectors<int64_t, std::string>(*filtered);
+    const std::vector<int64_t> expectedValues{ 3, 4 };
+    const std::vector<std::string> expectedLabels{ "f", "c" };
+    BOOST_CHECK_EQUAL_RANGES(filteredValues, expectedValues);
+    BOOST_CHECK_EQUAL_RANGES(filteredLabels, expectedLabels);
+
+    // grouping by sorted key goes over runs of equal values
+    const auto aggregated = abominableGroupAggregate(nonNull->column(0), { { nonNull->column(1), { AggregateFunction::Length } } });
+    const auto [keys, lengths] = toVectors<int64_t, double>(*aggregated);
+    const std::vector<int64_t> expectedKeys{ 1, 3, 4, 5 };
+    const std::vector<double> expectedLengths{ 2, 1, 1, 1 };
+    BOOST_CHECK_EQUAL_RANGES(keys, expectedKeys);
+    BOOST_CHECK_EQUAL_RANGES(lengths, expectedLengths);
+    BOOST_CHECK(isKnownSorted(*aggregated->column(0), SortOrder::Ascending, NullPosition::After));
+
+    // values changed in place lose their statistics
+    BOOST_CHECK(!readStatistics(*shift(nonNull->column(0), 1)));
+}
+
+BOOST_AUTO_TEST_CASE(PermuteWithRepeatedIndicesDropsValueStatistics)
+{
+    const auto values = annotateStatistics(toColumn(std::vector<std::optional<int64_t>>{ 5, 1, 4, std::nullopt, 1, 3 }, "values"));
+
+    // row count unchanged, but the values are not: 5 twice, 1 once
+    const auto repeated = permute(values, Permutation{ 0, 0, 2, 3, 4, 5 });
+    const auto repeatedStatistics = readStatistics(*repeated);
+    BOOST_CHECK(!repeatedStatistics || (!repeatedStatistics->min && !repeatedStatistics->distinctCount && !repeatedStatistics->nullCount));
+
+    const auto shuffledRepeated = permute(values, Permutation{ 2, 0, 0, 1, 3, 4 });
+    BOOST_CHECK(!readStatistics(*shuffledRepeated));
+
+    // a true permutation keeps the values
+    const auto reversed = permute(values, Permutation{ 5, 4, 3, 2, 1, 0 });
+    const auto reversedStatistics = readStatistics(*reversed);
+    BOOST_REQUIRE(reversedStatistics);
+    BOOST_CHECK(!reversedStatistics->isSorted());
+    BOOST_CHECK_EQUAL(get<int64_t>(reversedStatistics->min.value()), 1);
+    BOOST_CHECK_EQUAL(reversedStatistics->distinctCount.value(), 4);
+
+    // repeating rows of a sorted column keeps it sorted
+    const auto sorted = annotateStatistics(toColumn(std::vector<int64_t>{ 1, 2, 3 }, "sorted"));
+    const auto repeatedSorted = permute(sorted, Permutation{ 0, 0, 2 });
+    BOOST_CHECK(isKnownSorted(*repeatedSorted, SortOrder::Ascending, NullPosition::Before));
+    BOOST_CHECK(!readStatistics(*repeatedSorted)->max);
+}
+
+BOOST_AUTO_TEST_CASE(FilterSortedDoublesWithNaN)
+{
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    const auto values = toColumn(std::vector<double>{ 2.5, nan, -1.0, 4.0, 0.5 }, "values");
+    const auto table = tableFromColumns({ values });
+
+    // NaNs end up at one end, but they are not ordered, so filtering must evaluate the predicate
+    for(auto order : { SortOrder::Ascending, SortOrder::Descending })
+    {
+        const auto sorted = sortTable(table, { { table->column(0), order } });
+        BOOST_CHECK(!isKnownSorted(*sorted->column(0)));
+
+        const auto greater = toVector<double>(*filter(sorted, R"({"predicate": "gt", "arguments": [ {"column": "values"}, 1.5 ]})")->column(0));
+        const auto lesser = toVector<double>(*filter(sorted, R"({"predicate": "lt", "arguments": [ {"column": "values"}, 3.0 ]})")->column(0));
+        const auto expectedGreater = order == SortOrder::Ascending ? std::vector<double>{ 2.5, 4.0 } : std::vector<double>{ 4.0, 2.5 };
+        const auto expectedLesser = order == SortOrder::Ascending ? std::vector<double>{ -1.0, 0.5, 2.5 } : std::vector<double>{ 2.5, 0.5, -1.0 };
+        BOOST_CHECK_EQUAL_RANGES(greater, expectedGreater);
+        BOOST_CHECK_EQUAL_RANGES(lesser, expectedLesser);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(UngroupSimple)
 {
     const auto table = readTableFromFile("data/ungroupable.csv");